@@ -0,0 +1,31 @@
+#ifndef __OPTBOT_BENCH_INC__
+#define __OPTBOT_BENCH_INC__
+
+#include <stdlib.h>
+#include <time.h>
+
+/* Helpers shared by the benchmarks */
+
+/*! Gets the time since start
+ *
+ *  @param [start] When timing started, from clock_gettime(CLOCK_MONOTONIC)
+ *  @return The nanoseconds elapsed since start
+ */
+static inline double elapsed_ns(struct timespec* start) {
+  struct timespec end;
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  return (end.tv_sec - start->tv_sec) * 1e9 + (end.tv_nsec - start->tv_nsec);
+}
+
+/*! Gets the exit status of a benchmark from what its loops added up
+ *
+ *  Using the total keeps the loops from being optimized away.
+ *
+ *  @param [total] The sum of what the timed loops read back
+ *  @return EXIT_SUCCESS, or EXIT_FAILURE if nothing was read back
+ */
+static inline int bench_status(long total) {
+  return total == 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+#endif
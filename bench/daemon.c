@@ -0,0 +1,145 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "liboptbot.h"
+#include "optbotd.h"
+#include "test_spec.h"
+#include "bench.h"
+
+/* Compares the throughput of parsing a command line in-process, the way a
+   short-lived command does on every run, against handing it to optbotd.
+   The server runs in this process, but clients only reach it through its
+   socket, as they would a separate daemon. */
+
+#define PARSES 200000
+#define CLIENTS 4 /* Client threads, and workers for the server */
+
+static const char* argv[] = {"-vv", "--file", "out.txt", "-rone", "two",
+  "leftover"};
+static const int argc = 6;
+
+static char path[64];
+
+/* What every run of a command does without a spec */
+static bool parse_built(void) {
+  struct cli_arg_list* arg_list = init_cli_arg_list();
+  bool parsed;
+
+  if(! arg_list) return false;
+  add_arg(arg_list, 'v', "verbose", "Enable verbose output", false);
+  add_arg(arg_list, 'q', "quiet", "Disable output", false);
+  add_arg(arg_list, 'f', "file", "File to output to", true);
+  add_arg(arg_list, 'r', "record", "Record some data", true);
+  add_arg(arg_list, '\0', "long-only", "An option with no short form",
+    false);
+  add_arg(arg_list, 'x', NULL, "An option with no long form", true);
+  parsed = parse_command_line(arg_list, argc, argv);
+  destroy_cli_arg_list(arg_list);
+  return parsed;
+}
+
+static bool parse_spec(void) {
+  struct cli_arg_list* arg_list = init_cli_arg_list_spec(&test_spec);
+  bool parsed;
+
+  if(! arg_list) return false;
+  parsed = parse_command_line(arg_list, argc, argv);
+  destroy_cli_arg_list(arg_list);
+  return parsed;
+}
+
+/* A command connecting to optbotd once per run */
+static bool parse_remote(void) {
+  struct cli_arg_list* arg_list = init_cli_arg_list_spec(&test_spec);
+  bool parsed;
+
+  if(! arg_list) return false;
+  parsed = parse_command_line_remote(arg_list, path, argc, argv);
+  destroy_cli_arg_list(arg_list);
+  return parsed;
+}
+
+/* The cost of the round trip alone, over a connection kept open */
+static void* run_persistent(void* parses_ptr) {
+  struct cli_arg_list* arg_list = init_cli_arg_list_spec(&test_spec);
+  int parses = *(int*)parses_ptr;
+  int fd = optbotd_connect(path);
+  int i;
+
+  if(! arg_list || fd < 0) exit(EXIT_FAILURE);
+  for(i = 0; i < parses; i++) {
+    reset_cli_arg_list(arg_list);
+    if(! parse_command_line_remote_fd(arg_list, fd, argc, argv))
+      exit(EXIT_FAILURE);
+  }
+  close(fd);
+  destroy_cli_arg_list(arg_list);
+  return NULL;
+}
+
+static void* run_parses(void* parse_ptr) {
+  bool (*parse)(void) = *(bool (**)(void))parse_ptr;
+  int i;
+
+  for(i = 0; i < PARSES / CLIENTS; i++)
+    if(! parse()) exit(EXIT_FAILURE);
+  return NULL;
+}
+
+static void report(const char* name, struct timespec* start, int parses) {
+  double ns = elapsed_ns(start);
+  printf("%-26s %8.0f parses/s %8.2f us/parse\n", name, parses / ns * 1e9,
+    ns / parses / 1000);
+}
+
+static void bench(const char* name, bool (*parse)(void)) {
+  struct timespec start;
+  pthread_t clients[CLIENTS];
+  int i;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for(i = 0; i < PARSES; i++)
+    if(! parse()) exit(EXIT_FAILURE);
+  report(name, &start, PARSES);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for(i = 0; i < CLIENTS; i++)
+    pthread_create(&clients[i], NULL, run_parses, &parse);
+  for(i = 0; i < CLIENTS; i++)
+    pthread_join(clients[i], NULL);
+  report("  over threads", &start, PARSES / CLIENTS * CLIENTS);
+}
+
+int main(void) {
+  const struct optbot_spec* specs[] = {&test_spec};
+  struct optbotd* server;
+  struct timespec start;
+  pthread_t clients[CLIENTS];
+  int parses = PARSES;
+  int i;
+
+  snprintf(path, sizeof(path), "/tmp/optbot-bench-%d.sock", (int)getpid());
+  server = optbotd_start(path, specs, 1, CLIENTS);
+  if(! server) return EXIT_FAILURE;
+
+  bench("in-process, add_arg", parse_built);
+  bench("in-process, spec", parse_spec);
+  bench("optbotd, connect per call", parse_remote);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  run_persistent(&parses);
+  report("optbotd, one connection", &start, PARSES);
+
+  parses = PARSES / CLIENTS;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for(i = 0; i < CLIENTS; i++)
+    pthread_create(&clients[i], NULL, run_persistent, &parses);
+  for(i = 0; i < CLIENTS; i++)
+    pthread_join(clients[i], NULL);
+  report("  over threads", &start, parses * CLIENTS);
+
+  optbotd_stop(server);
+  return EXIT_SUCCESS;
+}
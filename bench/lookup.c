@@ -0,0 +1,64 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "liboptbot.h"
+#include "bench.h"
+
+/* Compares the cost of looking options up and parsing a command line when
+   liboptbot is linked as a shared library against building it into the
+   program with OPTBOT_IMPLEMENTATION and OPTBOT_STATIC.  The same source is
+   built both ways by `make bench`. */
+
+#define LOOKUPS 10000000
+#define PARSES 1000000
+
+int main(void) {
+  const char* argv[] = {"prog", "-vv", "--file", "out.txt", "-rone", "two"};
+  struct cli_arg_list* arg_list = init_cli_arg_list();
+  struct timespec start;
+  long total = 0;
+  struct cli_arg* arg;
+  int verbose;
+  int i;
+
+  if(!arg_list) return EXIT_FAILURE;
+
+  add_arg(arg_list, 'd', "debug", "Enable debug output?", false);
+  add_arg(arg_list, 'f', "file", "File to output to", true);
+  add_arg(arg_list, 'h', "help", "Print help and exit", false);
+  add_arg(arg_list, 'r', "record", "Record some data", true);
+  arg = add_arg(arg_list, 'v', "verbose", "Enable verbose output?", false);
+  if(! arg) return EXIT_FAILURE;
+  verbose = arg->index;
+
+  if(! parse_command_line(arg_list, 6, argv)) {
+    fprintf(stderr, "%s\n", arg_list->message);
+    return EXIT_FAILURE;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for(i = 0; i < LOOKUPS; i++)
+    total += big_opt_arg(arg_list, "verbose")->times_set;
+  printf("big_opt_arg:    %6.2f ns/op\n", elapsed_ns(&start) / LOOKUPS);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for(i = 0; i < LOOKUPS; i++)
+    total += little_opt_arg(arg_list, 'v')->times_set;
+  printf("little_opt_arg: %6.2f ns/op\n", elapsed_ns(&start) / LOOKUPS);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for(i = 0; i < LOOKUPS; i++)
+    total += optbot_count(arg_list, verbose);
+  printf("optbot_count:   %6.2f ns/op\n", elapsed_ns(&start) / LOOKUPS);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for(i = 0; i < PARSES; i++) {
+    reset_cli_arg_list(arg_list);
+    total += parse_command_line(arg_list, 6, argv);
+  }
+  printf("parse:          %6.2f ns/op\n", elapsed_ns(&start) / PARSES);
+
+  destroy_cli_arg_list(arg_list);
+
+  return bench_status(total);
+}
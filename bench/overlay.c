@@ -0,0 +1,64 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "liboptbot.h"
+#include "bench.h"
+
+/* Compares applying a job's overrides by parsing the whole base command
+   line again with them on the end against parsing just the overrides into
+   an overlay of the already parsed base. */
+
+#define OPTIONS 200
+#define JOBS 20000
+
+int main(void) {
+  static char names[OPTIONS][16];
+  static char values[OPTIONS][16];
+  const char* argv[OPTIONS * 2 + 2];
+  const char** overrides = argv + OPTIONS * 2;
+  struct cli_arg_list* base = init_cli_arg_list();
+  struct cli_arg_list* list = init_cli_arg_list();
+  struct cli_arg_list* job;
+  struct timespec start;
+  long total = 0;
+  int i;
+
+  if(! base || ! list) return EXIT_FAILURE;
+
+  for(i = 0; i < OPTIONS; i++) {
+    snprintf(names[i], sizeof(names[i]), "--option%d", i);
+    snprintf(values[i], sizeof(values[i]), "value%d", i);
+    if(! add_arg(base, '\0', names[i] + 2, "An option", true)) return 1;
+    if(! add_arg(list, '\0', names[i] + 2, "An option", true)) return 1;
+    argv[i * 2] = names[i];
+    argv[i * 2 + 1] = values[i];
+  }
+  overrides[0] = "--option7";
+  overrides[1] = "job";
+
+  if(! parse_command_line(base, OPTIONS * 2, argv)) return EXIT_FAILURE;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for(i = 0; i < JOBS; i++) {
+    reset_cli_arg_list(list);
+    if(! parse_command_line(list, OPTIONS * 2 + 2, argv)) return 1;
+    total += optbot_values_length(list, 7);
+  }
+  printf("Re-parse with overrides: %8.2f us/job\n",
+    elapsed_ns(&start) / JOBS / 1000);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for(i = 0; i < JOBS; i++) {
+    job = init_cli_arg_list_overlay(base);
+    if(! job || ! parse_command_line(job, 2, overrides)) return 1;
+    total += optbot_values_length(job, 7);
+    destroy_cli_arg_list(job);
+  }
+  printf("Overlay:                 %8.2f us/job\n",
+    elapsed_ns(&start) / JOBS / 1000);
+
+  destroy_cli_arg_list(base);
+  destroy_cli_arg_list(list);
+
+  return bench_status(total);
+}
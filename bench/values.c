@@ -0,0 +1,68 @@
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "liboptbot.h"
+#include "bench.h"
+
+/* Compares an argument given a great many values stored the usual way, as a
+   copy of each value and a pointer to it, against the same argument packed
+   into a pool with arg_packed.  Memory is measured from the heap with
+   mallinfo2, so this needs glibc. */
+
+#define VALUES 500000
+#define PASSES 20
+
+static long run(const char* name, const char** argv, bool packed) {
+  struct cli_arg_list* arg_list = init_cli_arg_list();
+  struct cli_arg* arg;
+  struct timespec start;
+  size_t heap;
+  long total = 0;
+  int i;
+  int j;
+
+  if(! arg_list) exit(EXIT_FAILURE);
+  arg = add_arg(arg_list, 'r', "record", "Record some data", true);
+  if(! arg) exit(EXIT_FAILURE);
+  if(packed && ! arg_packed(arg)) exit(EXIT_FAILURE);
+
+  heap = mallinfo2().uordblks;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  if(! parse_command_line(arg_list, VALUES, argv)) exit(EXIT_FAILURE);
+  printf("%-8s parse: %6.2f ns/value", name, elapsed_ns(&start) / VALUES);
+  printf("  memory: %5.1f bytes/value",
+    (double)(mallinfo2().uordblks - heap) / VALUES);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for(j = 0; j < PASSES; j++)
+    for(i = 0; i < VALUES; i++)
+      total += cli_arg_value(arg, i)[0];
+  printf("  iterate: %5.2f ns/value\n",
+    elapsed_ns(&start) / VALUES / PASSES);
+
+  destroy_cli_arg_list(arg_list);
+  return total;
+}
+
+int main(void) {
+  const char** argv = malloc(sizeof(char*) * VALUES);
+  char* tokens = malloc(16 * VALUES);
+  long total;
+  int i;
+
+  if(! argv || ! tokens) return EXIT_FAILURE;
+  for(i = 0; i < VALUES; i++) {
+    snprintf(tokens + i * 16, 16, "-r%d", i);
+    argv[i] = tokens + i * 16;
+  }
+
+  total = run("values", argv, false);
+  total += run("packed", argv, true);
+
+  free(argv);
+  free(tokens);
+
+  return bench_status(total);
+}
@@ -3,11 +3,17 @@
 
 int main(int argc, const char** argv) {
  struct cli_arg_list* arg_list = init_cli_arg_list();
+  struct cli_arg* help;
 
   add_arg(arg_list, 'v', "verbose", "Should this program use "
     "verbose output?", false);
   add_arg(arg_list, 'n', "ninja", "Be a ninja.", false);
-  add_arg(arg_list, 'h', "help", "I HAVE NO IDEA WHAT I'M DOING.", false);
+  help = add_arg(arg_list, 'h', "help", "I HAVE NO IDEA WHAT I'M DOING.",
+    false);
+  if(! help) {
+    fputs(arg_list->message, stderr);
+    return 1;
+  }
   add_arg(arg_list, 'p', "pirate", "Be a pirate.", false);
   add_arg(arg_list, 'N', "name", "Your name", true);
 
@@ -16,7 +22,7 @@ int main(int argc, const char** argv) {
     return 1;
   }
 
-  if(little_opt_arg(arg_list, 'h')->times_set)
+  if(optbot_count(arg_list, help->index))
     print_help(arg_list);
 
   destroy_cli_arg_list(arg_list);
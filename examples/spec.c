@@ -0,0 +1,22 @@
+#include <stdio.h>
+#include "example_spec.h"
+
+int main(int argc, const char** argv) {
+  /* The options come from examples/spec.opts, so there's nothing to add */
+  struct cli_arg_list* arg_list = init_cli_arg_list_spec(&example_spec);
+
+  if(!parse_command_line(arg_list, argc, argv)) {
+    fputs(arg_list->message, stderr);
+    return 1;
+  }
+
+  if(optbot_count(arg_list, EXAMPLE_HELP))
+    print_help(arg_list);
+
+  if(optbot_count(arg_list, EXAMPLE_NAME))
+    printf("Hello, %s\n", optbot_value(arg_list, EXAMPLE_NAME, 0));
+
+  destroy_cli_arg_list(arg_list);
+
+  return 0;
+}
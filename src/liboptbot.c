@@ -2,6 +2,9 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
 
 #include "liboptbot.h"
 
@@ -16,8 +19,26 @@ struct cli_arg* init_cli_arg(void) {
   checkmem(cli_arg);
 
   cli_arg->values = NULL;
+  cli_arg->packed = false;
+  cli_arg->pool = NULL;
+  cli_arg->pool_length = 0;
+  cli_arg->pool_size = 0;
+  cli_arg->offsets = NULL;
   cli_arg->times_set = 0;
-  cli_arg->allow_multiple = false;
+  cli_arg->allow_multiple = true;
+  cli_arg->required = false;
+  cli_arg->max_times = 0;
+  cli_arg->index = -1;
+  cli_arg->constraint_words = 0;
+  cli_arg->conflicts = NULL;
+  cli_arg->requires = NULL;
+  cli_arg->positions = NULL;
+  cli_arg->validator = NULL;
+  cli_arg->free_result = NULL;
+  cli_arg->validator_data = NULL;
+  cli_arg->results = NULL;
+  cli_arg->from_spec = false;
+  cli_arg->base = NULL;
   cli_arg->description = NULL;
   cli_arg->big = NULL;
   cli_arg->little = '\0';
@@ -46,7 +67,63 @@ void print_cli_arg(struct cli_arg* cli_arg) {
   printf("Times Set: %d\n", cli_arg->times_set);
   printf("Values\n");
   for(i = 0; i < cli_arg->values_length; i++)
-    printf("  %d: %s\n", i, cli_arg->values[i]);
+    printf("  %d: %s\n", i, cli_arg_value(cli_arg, i));
+}
+
+/*! Stores the values of an argument packed into a single pool
+ *
+ *  Rather than a copy of each value and a pointer to it, the values are
+ *  kept back to back in one buffer along with a 32 bit offset for each.
+ *  This suits arguments that are given a great many times.  Values must
+ *  then be read with cli_arg_value or optbot_value instead of from values.
+ *
+ *  An argument that has held values unpacked before, and since been reset,
+ *  gives up the storage that was kept for them.
+ *
+ *  @param [cli_arg] The argument to pack
+ *  @return False if the argument already holds unpacked values, in which
+ *    case it is left as it was, true otherwise
+ */
+bool arg_packed(struct cli_arg* cli_arg) {
+  if(cli_arg->packed) return true;
+  if(cli_arg->values_length > 0) return false;
+
+  /* values_size counts the offsets of a packed argument, which it has none
+     of yet */
+  free(cli_arg->values);
+  cli_arg->values = NULL;
+  cli_arg->values_size = 0;
+  cli_arg->packed = true;
+  return true;
+}
+
+/*! Gets a value assigned to an argument, however its values are stored
+ *
+ *  @param [cli_arg] The argument
+ *  @param [i] The index of the value, in the order they were given
+ *  @return The value, or NULL if the argument doesn't have that many values
+ */
+const char* cli_arg_value(const struct cli_arg* cli_arg, int i) {
+  if(i < 0 || i >= cli_arg->values_length) return NULL;
+  if(cli_arg->packed) return cli_arg->pool + cli_arg->offsets[i];
+  return cli_arg->values[i];
+}
+
+/*! Frees the results of validating the values of an argument
+ *
+ *  @param [cli_arg] The argument whose results should be freed
+ */
+static void clear_results(struct cli_arg* cli_arg) {
+  int i;
+
+  if(! cli_arg->results) return;
+
+  if(cli_arg->free_result) {
+    for(i = 0; i < cli_arg->values_length; i++)
+      if(cli_arg->results[i]) cli_arg->free_result(cli_arg->results[i]);
+  }
+  free(cli_arg->results);
+  cli_arg->results = NULL;
 }
 
 /* Destructor for args
@@ -55,11 +132,25 @@ void print_cli_arg(struct cli_arg* cli_arg) {
  */
 void destroy_cli_arg(struct cli_arg* cli_arg) {
   int i;
-  free(cli_arg->description);
-  free(cli_arg->big);
-  for(i = 0; i < cli_arg->values_length; i++)
+  clear_results(cli_arg);
+  for(i = 0; i < cli_arg->values_length && ! cli_arg->packed; i++)
     free(cli_arg->values[i]);
   free(cli_arg->values);
+  free(cli_arg->pool);
+  free(cli_arg->offsets);
+  free(cli_arg->positions);
+  free(cli_arg->conflicts);
+  free(cli_arg->requires);
+
+  /* Arguments from a spec are stored by their list, and borrow their
+     strings from the spec.  Overrides in an overlay borrow theirs from the
+     argument they override. */
+  if(cli_arg->from_spec) return;
+
+  if(! cli_arg->base) {
+    free(cli_arg->description);
+    free(cli_arg->big);
+  }
   free(cli_arg);
 }
 
@@ -74,24 +165,54 @@ struct cli_arg_list* init_cli_arg_list(void) {
   struct cli_arg_list* list;
   list = malloc(sizeof(struct cli_arg_list));
   list->head = NULL;
+  list->args = NULL;
+  list->arg_count = 0;
+  list->args_size = 0;
+  list->bitset_words = 0;
+  list->seen = NULL;
+  list->required = NULL;
+  list->changed = NULL;
+  list->argv_changed = false;
+  list->borrowing = false;
+  list->spec = NULL;
+  list->base = NULL;
+  list->touched = NULL;
+  list->touched_length = 0;
+  list->touched_size = 0;
+  list->invalid = NULL;
+  list->invalid_length = 0;
   list->error = none;
   list->argc = 0;
   list->argv = NULL;
   list->argv_size = 0;
+  list->argv_positions = NULL;
+  list->devour_flag = false;
   list->message = (char*)malloc(sizeof(char) * OPTBOT_ERROR_MSG_SIZE);
+  list->message[0] = '\0';
   return list;
 }
 
+/*! Sets the error for the given list to out_of_memory
+ *
+ *  @param [list] The list that the error occured on
+ */
+static void out_of_memory_error(struct cli_arg_list* list) {
+  list->error = out_of_memory;
+  snprintf(list->message, OPTBOT_ERROR_MSG_SIZE - 1,
+    "Failed to allocate memory.");
+}
+
 /*! Pushes a value onto an array of strings
  *
  *  @param [in,out] [len] The length of the array
  *  @param [in,out] [size] The size of the array
  *  @param [in,out] [ary] The address of the array of strings
  *  @param [value] The value to be pushed onto the array
+ *  @param [copy] Should a copy of value be pushed, rather than value itself?
  *  @return Operation successful?
  */
 static bool str_array_push(
-  int* len, int* size, char*** ary, const char* value)
+  int* len, int* size, char*** ary, const char* value, bool copy)
 {
   if(*len == *size) {
     *size += ARRAY_INIT_SIZE;
@@ -102,7 +223,7 @@ static bool str_array_push(
     memset(*ary + *len, 0, *size - *len);
   }
 
-  (*ary)[*len] = strdup(value);
+  (*ary)[*len] = copy ? strdup(value) : (char*)value;
   checkmem((*ary)[*len]);
   (*len)++;
 
@@ -112,26 +233,153 @@ static bool str_array_push(
     return false;
 }
 
+/*! Appends a value to the pool of a packed argument
+ *
+ *  The pool and the offsets are doubled as they fill, so that an argument
+ *  given many times isn't copied over and over.
+ *
+ *  @param [arg] The packed argument
+ *  @param [value] The value to append.  This is always copied.
+ *  @return Was the operation successful?
+ */
+static bool pool_push(struct cli_arg* arg, const char* value) {
+  size_t length = strlen(value) + 1;
+  size_t pool_size = arg->pool_size ? arg->pool_size : 64;
+  int values_size;
+  uint32_t* offsets;
+  char* pool;
+
+  /* Offsets are only 32 bits */
+  if(arg->pool_length + length > UINT32_MAX) goto error;
+
+  if(arg->values_length == arg->values_size) {
+    values_size = arg->values_size ? arg->values_size * 2 : ARRAY_INIT_SIZE;
+    offsets = realloc(arg->offsets, sizeof(uint32_t) * values_size);
+    checkmem(offsets);
+    arg->offsets = offsets;
+    arg->values_size = values_size;
+  }
+
+  while(pool_size < arg->pool_length + length)
+    pool_size *= 2;
+  if(pool_size != arg->pool_size) {
+    pool = realloc(arg->pool, pool_size);
+    checkmem(pool);
+    arg->pool = pool;
+    arg->pool_size = pool_size;
+  }
+
+  memcpy(arg->pool + arg->pool_length, value, length);
+  arg->offsets[arg->values_length++] = arg->pool_length;
+  arg->pool_length += length;
+
+  return true;
+
+  error:
+    return false;
+}
+
 /*! Adds the given value to the values list of the given arg
  *
- *  @param [arg] The argument to which the value should be added.  This string
- *    is copied for storage with the argument.
- *  @param [value] The value to add to the given argument
+ *  @param [list] The list that the argument belongs to
+ *  @param [arg] The argument to which the value should be added
+ *  @param [value] The value to add to the given argument.  This string is
+ *    copied for storage with the argument unless the list is borrowing.
+ *  @param [position] The position on the command line that value came from
  *  @return Was the operation successful?
  */
-static bool add_to_values(struct cli_arg* arg, const char* value) {
-  return str_array_push(
-    &arg->values_length, &arg->values_size, &arg->values, value);
+static bool add_to_values(struct cli_arg_list* list, struct cli_arg* arg,
+  const char* value, int position)
+{
+  int size = arg->values_size;
+
+  /* Results from an earlier validation no longer line up with the values */
+  clear_results(arg);
+
+  if(arg->packed) {
+    checkmem(pool_push(arg, value));
+  } else {
+    checkmem(str_array_push(&arg->values_length, &arg->values_size,
+      &arg->values, value, ! list->borrowing));
+  }
+
+  if(arg->values_size != size) {
+    arg->positions = realloc(arg->positions, sizeof(int) * arg->values_size);
+    checkmem(arg->positions);
+  }
+  arg->positions[arg->values_length - 1] = position;
+
+  return true;
+
+  error:
+    return false;
 }
 
 /*! Adds the given value to the leftover argv for the given list
  *
  * @param [list] The argument list to operate on
  * @param [value] The value to push onto the lists argv
+ * @param [position] The position on the command line that value came from
  * @return Operation successful?
  */
-static bool add_to_argv(struct cli_arg_list* list, const char* value) {
-  return str_array_push( &list->argc, &list->argv_size, &list->argv, value);
+static bool add_to_argv(struct cli_arg_list* list, const char* value,
+  int position)
+{
+  int size = list->argv_size;
+
+  checkmem(str_array_push(&list->argc, &list->argv_size, &list->argv, value,
+    ! list->borrowing));
+
+  if(list->argv_size != size) {
+    list->argv_positions = realloc(list->argv_positions,
+      sizeof(int) * list->argv_size);
+    checkmem(list->argv_positions);
+  }
+  list->argv_positions[list->argc - 1] = position;
+
+  return true;
+
+  error:
+    return false;
+}
+
+/*! Grows a bitset, clearing the newly added words
+ *
+ *  @param [in,out] [set] The address of the bitset to grow
+ *  @param [words] The number of words currently in the bitset
+ *  @param [new_words] The number of words the bitset should hold
+ *  @return Operation successful?
+ */
+static bool bitset_grow(unsigned long** set, int words, int new_words) {
+  unsigned long* grown;
+
+  grown = realloc(*set, sizeof(unsigned long) * new_words);
+  checkmem(grown);
+  memset(grown + words, 0, sizeof(unsigned long) * (new_words - words));
+  *set = grown;
+
+  return true;
+
+  error:
+    return false;
+}
+
+/*! Sets the given bit in a bitset
+ *
+ *  @param [set] The bitset to operate on
+ *  @param [bit] The bit to set
+ */
+static void bitset_set(unsigned long* set, int bit) {
+  set[bit / OPTBOT_WORD_BITS] |= 1UL << (bit % OPTBOT_WORD_BITS);
+}
+
+/*! Gets the number of words a bitset needs to hold the given bit
+ *
+ *  @param [bit] The bit that the bitset must be able to hold
+ *  @return The number of words needed
+ */
+static int bitset_words_for(int bit) {
+  return bit / OPTBOT_WORD_BITS + 1;
 }
 
 
@@ -158,9 +406,11 @@ static struct cli_arg_list_node* cli_arg_list_last(
  *  @param [node] The node to be destroyed
  */
 static void destroy_cli_arg_list_node(struct cli_arg_list_node* node) {
+  bool from_spec;
   if(!node) return;
+  from_spec = node->arg->from_spec;
   destroy_cli_arg(node->arg);
-  free(node);
+  if(! from_spec) free(node);
 }
 
 /*! Deletes the given node from the given list
@@ -173,7 +423,7 @@ static void destroy_cli_arg_list_node(struct cli_arg_list_node* node) {
  *  @return True if the node was deleted, false if the node could not be found
  *    in the list
  */
-bool cli_arg_list_delete_node(struct cli_arg_list* list,
+static bool cli_arg_list_delete_node(struct cli_arg_list* list,
   struct cli_arg_list_node* node)
 {
   struct cli_arg_list_node* head = list->head;
@@ -202,16 +452,38 @@ bool cli_arg_list_delete_node(struct cli_arg_list* list,
  *  @param [list] The list to be destroyed
  */
 void destroy_cli_arg_list(struct cli_arg_list* list) {
+  /* The arguments and nodes of a spec are each allocated in one block,
+     and come first in the list */
+  bool owns_spec = list->spec && ! list->base;
+  struct cli_arg* spec_args =
+    owns_spec && list->spec->arg_count ? list->args[0] : NULL;
+  struct cli_arg_list_node* spec_nodes =
+    owns_spec && list->spec->arg_count ? list->head : NULL;
   int i;
 
   while(list->head)
     cli_arg_list_delete_node(list, list->head);
+  for(i = 0; i < list->touched_length; i++)
+    destroy_cli_arg(list->touched[i]);
+  free(list->touched);
+  free(spec_args);
+  free(spec_nodes);
   free(list->message);
 
   for(i = 0; i < list->argc; i++){
     free(list->argv[i]);
   }
   free(list->argv);
+  free(list->argv_positions);
+
+  /* An overlay borrows these from its base */
+  if(! list->base) {
+    free(list->args);
+    free(list->required);
+  }
+  free(list->seen);
+  free(list->changed);
+  free(list->invalid);
 
   free(list);
 }
@@ -249,6 +521,22 @@ void print_cli_arg_list(struct cli_arg_list* list) {
   }
 }
 
+/*! Checks that the arguments and constraints of a list can be changed
+ *
+ *  An overlay shares them with its base, which must not change.
+ *
+ *  @param [list] The list about to be changed
+ *  @return False, with the list's error set, if list is an overlay
+ */
+static bool check_not_overlay(struct cli_arg_list* list) {
+  error_check(list, ! list->base, overlay_read_only,
+    "An overlay can't change the arguments of its base!");
+  return true;
+
+  error:
+    return false;
+}
+
 /*! Adds an argument to the given list
  *
  *  @return True if the node could be added, false if an error occured
@@ -258,6 +546,25 @@ static bool add_cli_arg(struct cli_arg_list* list, struct cli_arg* arg) {
   struct cli_arg_list_node* last = cli_arg_list_last(list);
   checkmem(next);
 
+  if(list->arg_count == list->args_size) {
+    list->args_size += ARRAY_INIT_SIZE;
+    list->args = realloc(list->args, sizeof(struct cli_arg*) * list->args_size);
+    checkmem(list->args);
+  }
+
+  if(bitset_words_for(list->arg_count) > list->bitset_words) {
+    checkmem(bitset_grow(&list->seen, list->bitset_words,
+      bitset_words_for(list->arg_count)));
+    checkmem(bitset_grow(&list->required, list->bitset_words,
+      bitset_words_for(list->arg_count)));
+    checkmem(bitset_grow(&list->changed, list->bitset_words,
+      bitset_words_for(list->arg_count)));
+    list->bitset_words = bitset_words_for(list->arg_count);
+  }
+
+  arg->index = list->arg_count;
+  list->args[list->arg_count++] = arg;
+
   next->arg = arg;
   if(last) {
     last->next = next;
@@ -268,9 +575,110 @@ static bool add_cli_arg(struct cli_arg_list* list, struct cli_arg* arg) {
   return true;
 
   error:
+    free(next);
     return false;
 }
 
+/*! Determines whether an argument is denoted by opt and type
+ *
+ *  @param [type] The type of argument that opt contains
+ *  @param [arg] The argument to check
+ *  @param [opt] The option to check the argument against
+ *  @return Does the argument take the given option?
+ */
+static bool arg_matches(enum arg_type type, const struct cli_arg* arg,
+  const char* opt)
+{
+  if(type == big) return arg->big && strcmp(arg->big, opt) == 0;
+  return arg->little == *opt;
+}
+
+/*! Gets the argument an overlay uses in place of one from its base
+ *
+ *  Overlays only touch a few arguments, so they're simply searched.
+ *
+ *  @param [list] The overlay
+ *  @param [arg] An argument of the overlay's base, or NULL
+ *  @return The overlay's override of arg if it has one, otherwise arg
+ */
+static struct cli_arg* overlay_arg(const struct cli_arg_list* list,
+  const struct cli_arg* arg)
+{
+  int i;
+
+  if(! arg) return NULL;
+  for(i = 0; i < list->touched_length; i++)
+    if(list->touched[i]->index == arg->index) return list->touched[i];
+  return (struct cli_arg*)arg;
+}
+
+/*! Gets an argument of a list, or of an overlay, by its handle
+ *
+ *  @param [list] The list the argument belongs to
+ *  @param [handle] The handle of the argument
+ *  @return The argument with the given handle
+ */
+static struct cli_arg* handle_arg(const struct cli_arg_list* list,
+  int handle)
+{
+  if(list->base) return overlay_arg(list, list->args[handle]);
+  return list->args[handle];
+}
+
+/*! Gets an argument that a parse can write to
+ *
+ *  For an overlay, this is an override of an argument of the base, which is
+ *  made the first time the argument is given.  It takes the base
+ *  argument's definition, but none of its values.  Any other list's
+ *  arguments are written to directly.
+ *
+ *  @param [list] The list being parsed
+ *  @param [arg] The argument that was given, as looked up in list
+ *  @return The argument to write to, or NULL if an override couldn't be made
+ */
+static struct cli_arg* touch_arg(struct cli_arg_list* list,
+  struct cli_arg* arg)
+{
+  struct cli_arg* copy = NULL;
+  struct cli_arg** grown;
+
+  if(! list->base || arg->base) return arg;
+
+  if(list->touched_length == list->touched_size) {
+    grown = realloc(list->touched,
+      sizeof(struct cli_arg*) * (list->touched_size + ARRAY_INIT_SIZE));
+    checkmem(grown);
+    list->touched = grown;
+    list->touched_size += ARRAY_INIT_SIZE;
+  }
+
+  copy = malloc(sizeof(struct cli_arg));
+  checkmem(copy);
+  *copy = *arg;
+  copy->times_set = 0;
+  copy->values_length = 0;
+  copy->values_size = 0;
+  copy->values = NULL;
+  copy->pool = NULL;
+  copy->pool_length = 0;
+  copy->pool_size = 0;
+  copy->offsets = NULL;
+  copy->positions = NULL;
+  copy->results = NULL;
+  /* Constraints are always checked against the base's arguments */
+  copy->constraint_words = 0;
+  copy->conflicts = NULL;
+  copy->requires = NULL;
+  copy->from_spec = false;
+  copy->base = arg;
+
+  list->touched[list->touched_length++] = copy;
+  return copy;
+
+  error:
+    return NULL;
+}
+
 /*! Searches an argument list for the argument denoted by opt and type
  *
  *  @param [type] The type of argument that opt contains.  This will be
@@ -286,13 +694,25 @@ static struct cli_arg* cli_arg_list_find(enum arg_type type,
   /* NOTE: opt will be a pointer to a single character, rather
      than a null-terminated string if type is set to little. */
   struct cli_arg_list_node* list_head = list->head;
+  int i;
+
+  if(list->base)
+    return overlay_arg(list, cli_arg_list_find(type, list->base, opt));
+
+  if(list->spec) {
+    i = type == big ? list->spec->find_big(opt) : list->spec->find_little(*opt);
+    if(i >= 0) return list->args[i];
+
+    /* Only arguments added with add_arg are left to search */
+    for(i = list->spec->arg_count; i < list->arg_count; i++) {
+      if(arg_matches(type, list->args[i], opt)) return list->args[i];
+    }
+    return NULL;
+  }
+
   if(! list_head) return NULL;
   while(list_head) {
-    if(type == big) {
-      if(strcmp(list_head->arg->big, opt) == 0) break;
-    } else if(type == little) {
-      if(list_head->arg->little == *opt) break;
-    }
+    if(arg_matches(type, list_head->arg, opt)) break;
     list_head = list_head->next;
   }
   return list_head ? list_head->arg : NULL;
@@ -329,11 +749,18 @@ struct cli_arg* big_opt_arg(struct cli_arg_list* list, const char* big_opt) {
  *  @param [big] The big option for the new argument
  *  @param [description] The description of the argument
  *  @param [takes_value] Does this parameter take a value?
+ *  @return The new argument, or NULL if it could not be added, which is
+ *    always the case for an overlay.  The argument stays valid until the
+ *    list is destroyed, and its index can be used as a handle with the
+ *    optbot_ accessors.
  */
-bool add_arg(struct cli_arg_list* arg_list, char little, const char* big,
-  const char* description, bool takes_value)
+struct cli_arg* add_arg(struct cli_arg_list* arg_list, char little,
+  const char* big, const char* description, bool takes_value)
 {
-  struct cli_arg* cli_arg = init_cli_arg();
+  struct cli_arg* cli_arg;
+
+  if(! check_not_overlay(arg_list)) return NULL;
+  cli_arg = init_cli_arg();
   checkmem(cli_arg);
 
   cli_arg->little = little;
@@ -354,11 +781,391 @@ bool add_arg(struct cli_arg_list* arg_list, char little, const char* big,
    add_cli_arg returns false for anything other than memory issues */
   checkmem(add_cli_arg(arg_list, cli_arg));
 
+  return cli_arg;
+
+  error:
+    if(cli_arg) destroy_cli_arg(cli_arg);
+    out_of_memory_error(arg_list);
+    return NULL;
+}
+
+/*! Initializer for argument lists with a fixed set of arguments
+ *
+ *  The arguments come from a spec, usually generated by optbotgen, and are
+ *  looked up with the spec's own functions rather than by searching the
+ *  list.  Their strings are borrowed from the spec, and all of them are
+ *  stored in a single allocation.  More arguments can still be added with
+ *  add_arg, but looking them up falls back to a search.
+ *
+ *  @param [spec] The spec describing the arguments.  This must outlive the
+ *    list.
+ *  @return The initialized list, or NULL if it could not be created
+ */
+struct cli_arg_list* init_cli_arg_list_spec(const struct optbot_spec* spec) {
+  struct cli_arg_list* list = init_cli_arg_list();
+  struct cli_arg* args = NULL;
+  struct cli_arg_list_node* nodes = NULL;
+  const struct optbot_spec_arg* spec_arg;
+  int words = bitset_words_for(spec->arg_count);
+  int i;
+
+  checkmem(list);
+  if(! spec->arg_count) {
+    list->spec = spec;
+    return list;
+  }
+
+  args = calloc(spec->arg_count, sizeof(struct cli_arg));
+  checkmem(args);
+  nodes = calloc(spec->arg_count, sizeof(struct cli_arg_list_node));
+  checkmem(nodes);
+  list->args = malloc(sizeof(struct cli_arg*) * spec->arg_count);
+  checkmem(list->args);
+  checkmem(bitset_grow(&list->seen, 0, words));
+  checkmem(bitset_grow(&list->required, 0, words));
+  checkmem(bitset_grow(&list->changed, 0, words));
+
+  for(i = 0; i < spec->arg_count; i++) {
+    spec_arg = &spec->args[i];
+    args[i].little = spec_arg->little;
+    args[i].big = (char*)spec_arg->big;
+    args[i].description = (char*)spec_arg->description;
+    args[i].takes_value = spec_arg->takes_value;
+    arg_max_times(&args[i], spec_arg->max_times);
+    args[i].index = i;
+    args[i].from_spec = true;
+
+    list->args[i] = &args[i];
+    nodes[i].arg = &args[i];
+    nodes[i].next = i < spec->arg_count - 1 ? &nodes[i + 1] : NULL;
+  }
+
+  list->head = nodes;
+  list->arg_count = list->args_size = spec->arg_count;
+  list->bitset_words = words;
+  list->spec = spec;
+
+  return list;
+
+  error:
+    free(args);
+    free(nodes);
+    if(list) destroy_cli_arg_list(list);
+    return NULL;
+}
+
+/*! Initializer for overlays, lists parsed on top of an already parsed one
+ *
+ *  An overlay starts out reading just like its base.  Each argument given
+ *  when the overlay is parsed gets an override, with the base argument's
+ *  definition but only the overlay's values, and every other lookup falls
+ *  through to the base.  Leftover params of the overlay's own parse are in
+ *  its argv.  Constraints are checked against what the base and the
+ *  overlay set together.
+ *
+ *  The base is only ever read, so any number of overlays, on any number of
+ *  threads, can share one.  An overlay costs about what its own parse does.
+ *  It can be parsed, reset, validated and read like any other list, but
+ *  add_arg, the arg_ constraint functions, reparse_command_line and
+ *  unpack_cli_arg_list fail on it with overlay_read_only, and it packs as
+ *  that error too.  Arguments looked up through an overlay that it hasn't
+ *  overridden are the base's own, and must not be changed either.  An
+ *  overlay can't be the base of another, as parsing the top one would
+ *  write into the overrides of the one below.
+ *
+ *  @param [base] The parsed list to overlay.  This must not change, and must
+ *    outlive the overlay.
+ *  @return The initialized overlay, or NULL if it could not be created or
+ *    base is itself an overlay
+ */
+struct cli_arg_list* init_cli_arg_list_overlay(
+  const struct cli_arg_list* base)
+{
+  struct cli_arg_list* list = NULL;
+  size_t seen_size = sizeof(unsigned long) * base->bitset_words;
+
+  if(base->base) return NULL;
+  list = init_cli_arg_list();
+  checkmem(list);
+  list->seen = malloc(seen_size + 1);
+  checkmem(list->seen);
+  memcpy(list->seen, base->seen, seen_size);
+  list->changed = calloc(base->bitset_words + 1, sizeof(unsigned long));
+  checkmem(list->changed);
+
+  list->base = base;
+  list->args = base->args;
+  list->arg_count = base->arg_count;
+  list->bitset_words = base->bitset_words;
+  list->required = base->required;
+  list->spec = base->spec;
+  list->devour_flag = base->devour_flag;
+
+  return list;
+
+  error:
+    if(list) destroy_cli_arg_list(list);
+    return NULL;
+}
+
+/*! Gets an argument by its handle
+ *
+ *  Handles are the index field of the arguments returned by add_arg.  They
+ *  are assigned in the order that arguments are added, starting at 0.
+ *
+ *  @param [list] The list the argument belongs to
+ *  @param [handle] The handle of the argument
+ *  @return The argument with the given handle
+ */
+struct cli_arg* optbot_arg(const struct cli_arg_list* list, int handle) {
+  return handle_arg(list, handle);
+}
+
+/*! Gets the number of times an argument was set by its handle
+ *
+ *  @param [list] The list the argument belongs to
+ *  @param [handle] The handle of the argument
+ *  @return The number of times the argument was set
+ */
+int optbot_count(const struct cli_arg_list* list, int handle) {
+  return handle_arg(list, handle)->times_set;
+}
+
+/*! Gets the number of values assigned to an argument by its handle
+ *
+ *  @param [list] The list the argument belongs to
+ *  @param [handle] The handle of the argument
+ *  @return The number of values held by the argument
+ */
+int optbot_values_length(const struct cli_arg_list* list, int handle) {
+  return handle_arg(list, handle)->values_length;
+}
+
+/*! Gets a value assigned to an argument by its handle
+ *
+ *  @param [list] The list the argument belongs to
+ *  @param [handle] The handle of the argument
+ *  @param [i] The index of the value, in the order they were given
+ *  @return The value, or NULL if the argument doesn't have that many values
+ */
+const char* optbot_value(const struct cli_arg_list* list, int handle, int i) {
+  return cli_arg_value(handle_arg(list, handle), i);
+}
+
+/*! Determines whether the last re-parse changed an argument by its handle
+ *
+ *  @param [list] The list the argument belongs to
+ *  @param [handle] The handle of the argument
+ *  @return Did reparse_command_line change the argument's count or values?
+ */
+bool optbot_changed(const struct cli_arg_list* list, int handle) {
+  return list->changed[handle / OPTBOT_WORD_BITS] >>
+    (handle % OPTBOT_WORD_BITS) & 1;
+}
+
+/*! Writes the name of an argument as it'd be given on the command line
+ *
+ *  @param [arg] The argument to name
+ *  @param [out] [buf] The buffer to write the name to
+ *  @param [size] The size of buf
+ *  @return buf
+ */
+static const char* arg_name(const struct cli_arg* arg, char* buf, int size) {
+  if(arg->big)
+    snprintf(buf, size, "--%s", arg->big);
+  else
+    snprintf(buf, size, "-%c", arg->little);
+  return buf;
+}
+
+/*! Marks an argument as required
+ *
+ *  A parse will fail with missing_required if the argument isn't given.
+ *
+ *  @param [list] The list that the argument belongs to
+ *  @param [arg] The argument that must be given
+ *  @return Operation successful?  This fails only for an overlay.
+ */
+bool arg_required(struct cli_arg_list* list, struct cli_arg* arg) {
+  if(! check_not_overlay(list)) return false;
+  arg->required = true;
+  bitset_set(list->required, arg->index);
+  return true;
+}
+
+/*! Limits the number of times an argument may be given
+ *
+ *  A parse will fail with set_twice if the argument is given more than
+ *  max_times times.  A limit of 1 is the same as clearing allow_multiple.
+ *
+ *  @param [arg] The argument to limit
+ *  @param [max_times] The most times the argument may be given, or 0 for no
+ *    limit
+ */
+void arg_max_times(struct cli_arg* arg, int max_times) {
+  arg->max_times = max_times;
+  arg->allow_multiple = max_times != 1;
+}
+
+/*! Adds the argument at bit to one of the constraint bitsets of arg
+ *
+ *  @param [arg] The argument whose constraints should be added to
+ *  @param [in,out] [set] The address of either arg->conflicts or
+ *    arg->requires
+ *  @param [bit] The index of the argument to add to the set
+ *  @return Operation successful?
+ */
+static bool add_constraint(struct cli_arg* arg, unsigned long** set, int bit) {
+  int words = bitset_words_for(bit);
+
+  if(words > arg->constraint_words) {
+    checkmem(bitset_grow(&arg->conflicts, arg->constraint_words, words));
+    checkmem(bitset_grow(&arg->requires, arg->constraint_words, words));
+    arg->constraint_words = words;
+  }
+
+  bitset_set(*set, bit);
+  return true;
+
+  error:
+    return false;
+}
+
+/*! Marks two arguments as mutually exclusive
+ *
+ *  A parse will fail with conflicting_opts if both arguments are given.
+ *
+ *  @param [list] The list that the arguments belong to
+ *  @param [arg] One of the conflicting arguments
+ *  @param [other] The other conflicting argument
+ *  @return Operation successful?
+ */
+bool arg_conflicts(struct cli_arg_list* list,
+  struct cli_arg* arg, struct cli_arg* other)
+{
+  if(! check_not_overlay(list)) return false;
+  checkmem(add_constraint(arg, &arg->conflicts, other->index));
+  checkmem(add_constraint(other, &other->conflicts, arg->index));
+  return true;
+
+  error:
+    out_of_memory_error(list);
+    return false;
+}
+
+/*! Makes one argument depend on another
+ *
+ *  A parse will fail with missing_dependency if arg is given without
+ *  dependency.
+ *
+ *  @param [list] The list that the arguments belong to
+ *  @param [arg] The dependent argument
+ *  @param [dependency] The argument that must be given along with arg
+ *  @return Operation successful?
+ */
+bool arg_requires(struct cli_arg_list* list,
+  struct cli_arg* arg, struct cli_arg* dependency)
+{
+  if(! check_not_overlay(list)) return false;
+  checkmem(add_constraint(arg, &arg->requires, dependency->index));
+  return true;
+
+  error:
+    out_of_memory_error(list);
+    return false;
+}
+
+/*! Records that an argument was given on the command line
+ *
+ *  @param [list] The list that the argument belongs to
+ *  @param [arg] The argument that was given
+ *  @return False if the argument was given more times than it allows
+ */
+static bool mark_set(struct cli_arg_list* list, struct cli_arg* arg) {
+  char name[OPTBOT_ERROR_MSG_SIZE / 2];
+  int limit = arg->allow_multiple ? arg->max_times : 1;
+
+  arg->times_set++;
+  bitset_set(list->seen, arg->index);
+
+  error_check(list, (limit == 0 || arg->times_set <= limit), set_twice,
+    "%s may only be given %d time(s)!",
+    arg_name(arg, name, sizeof(name)), limit);
+
+  return true;
+
+  error:
+    return false;
+}
+
+/*! Gets the index of the lowest bit set in a word
+ *
+ *  @param [word] The word to search.  This must not be zero.
+ *  @return The index of the lowest bit set in word
+ */
+static int lowest_bit(unsigned long word) {
+  return __builtin_ctzl(word);
+}
+
+/*! Checks the constraints of a list once its arguments have been parsed
+ *
+ *  The set arguments are compared a word at a time against the required set
+ *  and against the conflicts and requires sets of each argument that was
+ *  given, so the cost depends on the number of words rather than on the
+ *  number of arguments.
+ *
+ *  @param [list] The list to check
+ *  @return True if no constraint was broken, false otherwise
+ */
+static bool check_constraints(struct cli_arg_list* list) {
+  char name[OPTBOT_ERROR_MSG_SIZE / 4];
+  char other_name[OPTBOT_ERROR_MSG_SIZE / 4];
+  struct cli_arg* arg;
+  struct cli_arg* other;
+  unsigned long set;
+  unsigned long broken;
+  int words;
+  int w;
+  int v;
+
+  for(w = 0; w < list->bitset_words; w++) {
+    broken = list->required[w] & ~list->seen[w];
+    if(! broken) continue;
+
+    arg = list->args[w * OPTBOT_WORD_BITS + lowest_bit(broken)];
+    error_check(list, false, missing_required, "%s is required!",
+      arg_name(arg, name, sizeof(name)));
+  }
+
+  for(w = 0; w < list->bitset_words; w++) {
+    for(set = list->seen[w]; set; set &= set - 1) {
+      arg = list->args[w * OPTBOT_WORD_BITS + lowest_bit(set)];
+      words = arg->constraint_words < list->bitset_words ?
+        arg->constraint_words : list->bitset_words;
+
+      for(v = 0; v < words; v++) {
+        broken = arg->conflicts[v] & list->seen[v];
+        if(broken) {
+          other = list->args[v * OPTBOT_WORD_BITS + lowest_bit(broken)];
+          error_check(list, false, conflicting_opts,
+            "%s can't be used with %s!", arg_name(arg, name, sizeof(name)),
+            arg_name(other, other_name, sizeof(other_name)));
+        }
+
+        broken = arg->requires[v] & ~list->seen[v];
+        if(broken) {
+          other = list->args[v * OPTBOT_WORD_BITS + lowest_bit(broken)];
+          error_check(list, false, missing_dependency,
+            "%s requires %s!", arg_name(arg, name, sizeof(name)),
+            arg_name(other, other_name, sizeof(other_name)));
+        }
+      }
+    }
+  }
+
   return true;
 
   error:
-    arg_list->error = out_of_memory;
-    arg_list->message = "Failed to allocate memory.";
     return false;
 }
 
@@ -376,29 +1183,32 @@ bool add_arg(struct cli_arg_list* arg_list, char little, const char* big,
  *  @param [opt_str] The option string to match arguments against
  *  @param [next] The value which should be assigned to the last argument
  *    should it require one
+ *  @param [position] The position of opt_str on the command line
  *  @param [out] [ate_next] Was next consumed?
  *  @return True if all of the options in the given opt_str were successfully
  *    set, false otherwise
  */
 static bool parse_little(struct cli_arg_list* list,
-  const char* opt_str, const char* next, bool* ate_next)
+  const char* opt_str, const char* next, int position, bool* ate_next)
 {
   struct cli_arg* arg = little_opt_arg(list, opt_str[0]);
   bool arg_added = false;
 
   error_check(list, arg, invalid_opt, "%s is not a valid option!", opt_str);
+  arg = touch_arg(list, arg);
+  checkmem(arg);
 
-  arg->times_set++;
+  if(! mark_set(list, arg)) goto error;
 
   if(arg->takes_value && strlen(opt_str) > 1) {
-    checkmem(add_to_values(arg, opt_str + 1));
+    checkmem(add_to_values(list, arg, opt_str + 1, position));
     arg_added = true;
   } else if(arg->takes_value && next) {
-    checkmem(add_to_values(arg, next));
+    checkmem(add_to_values(list, arg, next, position + 1));
     arg_added = true;
     *ate_next = true;
   } else if(strlen(opt_str) > 1) {
-    return parse_little(list, opt_str + 1, next, ate_next);
+    return parse_little(list, opt_str + 1, next, position, ate_next);
   }
 
   error_check(list, ! (arg->takes_value &&! arg_added), value_required,
@@ -421,20 +1231,23 @@ static bool parse_little(struct cli_arg_list* list,
  *  @param [next] The value for the given option.  This is ignored if the
  *    parameter does not take a value.  Additionally, the value may be null,
  *    though it will cause an error if the argument expects a value.
+ *  @param [position] The position of opt_str on the command line
  *  @param [out] [ate_next] Was next consumed?
  *  @return True if the option was set.  False otherwise
  */
 static bool parse_big(struct cli_arg_list* list,
-  const char* opt_str, const char* next, bool* ate_next)
+  const char* opt_str, const char* next, int position, bool* ate_next)
 {
   struct cli_arg* arg = big_opt_arg(list, opt_str);
 
   error_check(list, arg, invalid_opt, "--%s is not a valid option!", opt_str);
+  arg = touch_arg(list, arg);
+  checkmem(arg);
 
-  arg->times_set++;
+  if(! mark_set(list, arg)) goto error;
 
   if(arg->takes_value && next) {
-    checkmem(add_to_values(arg, next));
+    checkmem(add_to_values(list, arg, next, position + 1));
     *ate_next = true;
   }
 
@@ -464,6 +1277,48 @@ static bool is_opt(const char* str) {
   return true;
 }
 
+/*! Parses a single command line token into an arg list
+ *
+ *  This does the work for both parse_command_line and parse_command_buffer,
+ *  so that the two stay in lock step.
+ *
+ *  @param [list] The argument list that will be populated
+ *  @param [token] The token to parse
+ *  @param [next] The token following this one, or NULL if there is none
+ *  @param [position] The position of token on the command line
+ *  @param [out] [ate_next] Was next consumed?
+ *  @param [in,out] [devour_mode] Has a -- been seen while the devour flag
+ *    is set?
+ *  @return True if the token was parsed successfully, false otherwise
+ */
+static bool parse_token(struct cli_arg_list* list, const char* token,
+  const char* next, int position, bool* ate_next, bool* devour_mode)
+{
+  if(strcmp(token, "--") == 0 && list->devour_flag) {
+    *devour_mode = true;
+    return true;
+  }
+
+  if(! is_opt(token) || *devour_mode)
+    return add_to_argv(list, token, position);
+
+  /* Is there a potential value following? */
+  if(next && is_opt(next)) next = NULL;
+
+  if(token[1] == '-')
+    return parse_big(list, token + 2, next, position, ate_next);
+  else
+    return parse_little(list, token + 1, next, position, ate_next);
+}
+
+/*! Fills in the error for a failed parse if nothing more specific was set
+ *
+ *  @param [list] The list that failed to parse
+ */
+static void parse_failed(struct cli_arg_list* list) {
+  if(list->error == none) out_of_memory_error(list);
+}
+
 /*! Parses the command line into an arg list
  *
  * @param [in,out] [list] The argument list that will be populated
@@ -486,36 +1341,777 @@ bool parse_command_line(struct cli_arg_list* list,
       continue;
     }
 
-    if(strcmp(argv[i], "--") == 0 && list->devour_flag) {
-      devour_mode = true;
-      continue;
-    }
+    next = i < argc - 1 ? argv[i + 1] : NULL;
+    if(! parse_token(list, argv[i], next, i, &ate_next, &devour_mode))
+      goto error;
+  }
+
+  if(! check_constraints(list)) goto error;
+
+  return true;
+
+  error:
+    parse_failed(list);
+    return false;
+}
+
+/*! Parses a buffer of NUL-separated arguments into an arg list
+ *
+ *  The buffer is laid out like /proc/<pid>/cmdline: each argument is
+ *  followed by a NUL.  It is walked in place and parsed with the same
+ *  semantics as parse_command_line, without building an argv for it.
+ *
+ *  @param [in,out] [list] The argument list that will be populated
+ *  @param [buf] The buffer of arguments.  The last byte must be a NUL.
+ *  @param [len] The length of buf in bytes, including the final NUL
+ *  @return True if the arguments were parsed successfully, false otherwise
+ */
+bool parse_command_buffer(struct cli_arg_list* list,
+  const char* buf, size_t len)
+{
+  const char* end = buf + len;
+  const char* token;
+  const char* next;
+  int position = 0;
+  bool ate_next = false;
+  bool devour_mode = false;
+
+  error_check(list, (len == 0 || buf[len - 1] == '\0'), bad_buffer,
+    "The command buffer is not NUL-terminated!");
 
-    if(! is_opt(argv[i]) || devour_mode) {
-      checkmem(add_to_argv(list, argv[i]));
+  for(token = len ? buf : NULL; token; token = next, position++) {
+    next = token + strlen(token) + 1;
+    if(next == end) next = NULL;
+
+    if(ate_next) {
+      ate_next = false;
       continue;
     }
 
-    /* Is there a potential value following? */
-    next = (i < argc - 1) && (! is_opt(argv[i + 1])) ? argv[i + 1] : NULL;
+    if(! parse_token(list, token, next, position, &ate_next, &devour_mode))
+      goto error;
+  }
+
+  if(! check_constraints(list)) goto error;
+
+  return true;
+
+  error:
+    parse_failed(list);
+    return false;
+}
+
+/*! Clears everything a parse put into an arg list
+ *
+ *  Option counts, values, leftover params and errors are cleared, but the
+ *  arguments themselves and the storage behind them are kept so that the
+ *  list can be cheaply reused for another parse.
+ *
+ *  @param [list] The list to reset
+ */
+void reset_cli_arg_list(struct cli_arg_list* list) {
+  struct cli_arg_list_node* node;
+  int i;
+
+  for(node = list->head; node; node = node->next) {
+    clear_results(node->arg);
+    for(i = 0; i < node->arg->values_length && ! node->arg->packed; i++)
+      free(node->arg->values[i]);
+    node->arg->values_length = 0;
+    node->arg->pool_length = 0;
+    node->arg->times_set = 0;
+  }
+
+  for(i = 0; i < list->touched_length; i++)
+    destroy_cli_arg(list->touched[i]);
+  list->touched_length = 0;
+
+  for(i = 0; i < list->argc; i++)
+    free(list->argv[i]);
+  list->argc = 0;
+
+  if(list->base)
+    memcpy(list->seen, list->base->seen,
+      sizeof(unsigned long) * list->bitset_words);
+  else
+    memset(list->seen, 0, sizeof(unsigned long) * list->bitset_words);
+  memset(list->changed, 0, sizeof(unsigned long) * list->bitset_words);
+  list->argv_changed = false;
+
+  free(list->invalid);
+  list->invalid = NULL;
+  list->invalid_length = 0;
+
+  list->error = none;
+  list->message[0] = '\0';
+}
+
+/* The parse state of an argument, or of a list's leftover params, set aside
+   while a re-parse decides whether to keep it */
+struct saved_parse {
+  int times_set; /* The number of times the argument was set */
+  int values_length; /* The number of values or params */
+  int values_size; /* The number allocated in values */
+  char** values; /* The values or params */
+  char* pool; /* The values, if the argument is packed */
+  size_t pool_length; /* The number of bytes used in pool */
+  size_t pool_size; /* The number of bytes allocated in pool */
+  uint32_t* offsets; /* The offset in pool of each value */
+  int* positions; /* The position on the command line of each value */
+  void** results; /* The results of validation for each value */
+};
+
+/*! Gets the parse state of an argument
+ *
+ *  @param [arg] The argument
+ *  @return Its parse state, which still belongs to it
+ */
+static struct saved_parse arg_parse(const struct cli_arg* arg) {
+  struct saved_parse parse = {arg->times_set, arg->values_length,
+    arg->values_size, arg->values, arg->pool, arg->pool_length,
+    arg->pool_size, arg->offsets, arg->positions, arg->results};
+  return parse;
+}
+
+/*! Gets the leftover params of a list as a parse state
+ *
+ *  @param [list] The list
+ *  @return Its params, which still belong to it
+ */
+static struct saved_parse argv_parse(const struct cli_arg_list* list) {
+  struct saved_parse parse = {0, list->argc, list->argv_size, list->argv,
+    NULL, 0, 0, NULL, list->argv_positions, NULL};
+  return parse;
+}
+
+/*! Swaps the parse state of an argument with a saved one
+ *
+ *  @param [arg] The argument to swap
+ *  @param [in,out] [saved] The saved state to swap with
+ */
+static void swap_arg_parse(struct cli_arg* arg, struct saved_parse* saved) {
+  struct saved_parse current = arg_parse(arg);
+
+  arg->times_set = saved->times_set;
+  arg->values_length = saved->values_length;
+  arg->values_size = saved->values_size;
+  arg->values = saved->values;
+  arg->pool = saved->pool;
+  arg->pool_length = saved->pool_length;
+  arg->pool_size = saved->pool_size;
+  arg->offsets = saved->offsets;
+  arg->positions = saved->positions;
+  arg->results = saved->results;
+  *saved = current;
+}
+
+/*! Swaps the leftover params of a list with saved ones
+ *
+ *  @param [list] The list to swap
+ *  @param [in,out] [saved] The saved params to swap with
+ */
+static void swap_argv_parse(struct cli_arg_list* list,
+  struct saved_parse* saved)
+{
+  struct saved_parse current = argv_parse(list);
+
+  list->argc = saved->values_length;
+  list->argv_size = saved->values_size;
+  list->argv = saved->values;
+  list->argv_positions = saved->positions;
+  *saved = current;
+}
+
+/*! Gets a value from a saved parse, however it's stored
+ *
+ *  @param [saved] The parse
+ *  @param [i] The index of the value
+ *  @return The value
+ */
+static const char* saved_value(const struct saved_parse* saved, int i) {
+  return saved->offsets ? saved->pool + saved->offsets[i] : saved->values[i];
+}
+
+/*! Determines whether two parses set the same values the same number of
+ *  times
+ *
+ *  @param [a] One parse
+ *  @param [b] The other parse
+ *  @return Are they the same?
+ */
+static bool same_parse(const struct saved_parse* a,
+  const struct saved_parse* b)
+{
+  int i;
+
+  if(a->times_set != b->times_set) return false;
+  if(a->values_length != b->values_length) return false;
+  for(i = 0; i < a->values_length; i++)
+    if(strcmp(saved_value(a, i), saved_value(b, i)) != 0) return false;
+
+  return true;
+}
+
+/*! Replaces each borrowed string in an array with a copy of it
+ *
+ *  @param [strings] The array of strings
+ *  @param [length] The number of strings in the array
+ *  @return False if a copy couldn't be made, in which case none are kept
+ */
+static bool copy_strings(char** strings, int length) {
+  int i;
+
+  for(i = 0; i < length; i++) {
+    strings[i] = strdup(strings[i]);
+    checkmem(strings[i]);
+  }
+
+  return true;
+
+  error:
+    while(i-- > 0) free(strings[i]);
+    return false;
+}
+
+/*! Frees a saved parse
+ *
+ *  @param [saved] The parse to free
+ *  @param [free_result] Frees the results of validation, or NULL
+ *  @param [owned] Were the strings in values copied, rather than borrowed?
+ */
+static void free_saved_parse(struct saved_parse* saved,
+  void (*free_result)(void*), bool owned)
+{
+  int i;
+
+  for(i = 0; i < saved->values_length; i++) {
+    if(owned && saved->values) free(saved->values[i]);
+    if(saved->results && free_result && saved->results[i])
+      free_result(saved->results[i]);
+  }
+  free(saved->values);
+  free(saved->pool);
+  free(saved->offsets);
+  free(saved->positions);
+  free(saved->results);
+}
+
+/*! Frees a borrowed parse that matched the one it would have replaced
+ *
+ *  @param [positions] The positions of the values that are being kept,
+ *    which are updated to where they were found in the borrowed parse
+ *  @param [saved] The borrowed parse
+ */
+static void drop_same_parse(int* positions, struct saved_parse* saved) {
+  if(saved->values_length)
+    memcpy(positions, saved->positions, sizeof(int) * saved->values_length);
+  free_saved_parse(saved, NULL, false);
+}
+
+/*! Parses a new command line into a list, keeping what hasn't changed
+ *
+ *  This stands in for reset_cli_arg_list and parse_command_line when a list
+ *  is given an updated command line, such as on a reload.  The new command
+ *  line is parsed without copying its strings and compared with the old
+ *  parse argument by argument.  Arguments given the same number of times
+ *  with the same values keep their old values, and the results of
+ *  validating them, untouched.  Only the values of arguments that changed
+ *  are copied, and those arguments are marked for optbot_changed.
+ *  argv_changed is set if the leftover params differ.  As after a reset,
+ *  the invalid values found by an earlier validation are cleared.
+ *
+ *  @param [in,out] [list] The list to re-parse
+ *  @param [argc] The number of string arguments contained in argv
+ *  @param [argv] An array of command line arguments
+ *  @return True if the arguments were parsed successfully.  Otherwise the
+ *    old parse is left in place, with the list's error set and nothing
+ *    marked as changed.  An overlay can't be re-parsed.
+ */
+bool reparse_command_line(struct cli_arg_list* list,
+  int argc, const char** argv)
+{
+  struct saved_parse* saved = NULL;
+  struct saved_parse saved_argv = {0, 0, 0, NULL, NULL, 0, 0, NULL, NULL,
+    NULL};
+  struct saved_parse current;
+  struct cli_arg* arg;
+  unsigned long* seen = NULL;
+  size_t seen_size = sizeof(unsigned long) * list->bitset_words;
+  bool parsed;
+  int i;
+
+  if(! check_not_overlay(list)) return false;
+
+  saved = calloc(list->arg_count + 1, sizeof(struct saved_parse));
+  checkmem(saved);
+  seen = malloc(seen_size + 1);
+  checkmem(seen);
 
-    if(argv[i][1] == '-') {
-      if(! parse_big(list, argv[i] + 2, next, &ate_next)) goto error;
+  memcpy(seen, list->seen, seen_size);
+  memset(list->seen, 0, seen_size);
+  memset(list->changed, 0, seen_size);
+  list->argv_changed = false;
+  list->error = none;
+  list->message[0] = '\0';
+
+  for(i = 0; i < list->arg_count; i++)
+    swap_arg_parse(list->args[i], &saved[i]);
+  swap_argv_parse(list, &saved_argv);
+
+  list->borrowing = true;
+  parsed = parse_command_line(list, argc, argv);
+  list->borrowing = false;
+  if(! parsed) goto restore;
+
+  /* The changed values are all copied before anything old is freed, so
+     that running out of memory can still put the old parse back */
+  for(i = 0; i < list->arg_count; i++) {
+    arg = list->args[i];
+    current = arg_parse(arg);
+    if(same_parse(&current, &saved[i])) continue;
+    if(! arg->packed && ! copy_strings(arg->values, arg->values_length))
+      goto restore;
+    bitset_set(list->changed, i);
+  }
+
+  current = argv_parse(list);
+  if(! same_parse(&current, &saved_argv)) {
+    if(! copy_strings(list->argv, list->argc)) goto restore;
+    list->argv_changed = true;
+  }
+
+  for(i = 0; i < list->arg_count; i++) {
+    arg = list->args[i];
+    if(optbot_changed(list, i)) {
+      free_saved_parse(&saved[i], arg->free_result, true);
     } else {
-      if(! parse_little(list, argv[i] + 1, next, &ate_next)) goto error;
+      swap_arg_parse(arg, &saved[i]);
+      drop_same_parse(arg->positions, &saved[i]);
+    }
+  }
+
+  if(list->argv_changed) {
+    free_saved_parse(&saved_argv, NULL, true);
+  } else {
+    swap_argv_parse(list, &saved_argv);
+    drop_same_parse(list->argv_positions, &saved_argv);
+  }
+
+  free(list->invalid);
+  list->invalid = NULL;
+  list->invalid_length = 0;
+
+  free(saved);
+  free(seen);
+  return true;
+
+  restore:
+    for(i = 0; i < list->arg_count; i++) {
+      swap_arg_parse(list->args[i], &saved[i]);
+      free_saved_parse(&saved[i], NULL, optbot_changed(list, i));
+    }
+    swap_argv_parse(list, &saved_argv);
+    free_saved_parse(&saved_argv, NULL, false);
+
+    memcpy(list->seen, seen, seen_size);
+    memset(list->changed, 0, seen_size);
+  error:
+    free(saved);
+    free(seen);
+    parse_failed(list);
+    return false;
+}
+
+/*! Appends a 32 bit integer to a packed parse result
+ *
+ *  @param [buf] The buffer being packed into
+ *  @param [size] The size of buf.  Nothing is written past it.
+ *  @param [in,out] [len] The length of the packed result so far
+ *  @param [value] The integer to append
+ */
+static void pack_u32(char* buf, size_t size, size_t* len, uint32_t value) {
+  if(*len + sizeof(value) <= size) memcpy(buf + *len, &value, sizeof(value));
+  *len += sizeof(value);
+}
+
+/*! Reads a 32 bit integer from a packed parse result
+ *
+ *  @param [buf] The packed result
+ *  @param [len] The length of buf
+ *  @param [in,out] [pos] The position of the integer in buf
+ *  @param [out] [value] The integer that was read
+ *  @return False if buf is too short to hold the integer
+ */
+static bool unpack_u32(const char* buf, size_t len, size_t* pos,
+  uint32_t* value)
+{
+  if(*pos + sizeof(*value) > len) return false;
+  memcpy(value, buf + *pos, sizeof(*value));
+  *pos += sizeof(*value);
+  return true;
+}
+
+/*! Packs the result of a parse into a compact binary form
+ *
+ *  Only the error, the arguments that were set and the leftover params are
+ *  packed.  Values and params are packed as the position of the token they
+ *  came from and their length, so they can only be unpacked against the
+ *  same command line.  See unpack_cli_arg_list.
+ *
+ *  An overlay's values come from two command lines, so an overlay is
+ *  packed as an overlay_read_only error instead.
+ *
+ *  @param [list] The parsed list to pack
+ *  @param [out] [buf] The buffer to pack into
+ *  @param [size] The size of buf
+ *  @return The length of the packed result.  If this is more than size, buf
+ *    was too small, and the result should be packed again into a buffer of
+ *    at least this size.
+ */
+size_t pack_cli_arg_list(const struct cli_arg_list* list, char* buf,
+  size_t size)
+{
+  static const char overlay_message[] = "An overlay can't be packed!";
+  enum cli_arg_error error = list->base ? overlay_read_only : list->error;
+  const char* message = list->base ? overlay_message : list->message;
+  size_t message_length = error == none ? 0 : strlen(message);
+  size_t len = 0;
+  const struct cli_arg* arg;
+  unsigned long set;
+  uint32_t set_count = 0;
+  int w;
+  int i;
+
+  pack_u32(buf, size, &len, error);
+  pack_u32(buf, size, &len, message_length);
+  if(len + message_length <= size) memcpy(buf + len, message,
+    message_length);
+  len += message_length;
+  if(error != none) return len;
+
+  for(w = 0; w < list->bitset_words; w++)
+    set_count += __builtin_popcountl(list->seen[w]);
+  pack_u32(buf, size, &len, set_count);
+
+  for(w = 0; w < list->bitset_words; w++) {
+    for(set = list->seen[w]; set; set &= set - 1) {
+      arg = list->args[w * OPTBOT_WORD_BITS + lowest_bit(set)];
+      pack_u32(buf, size, &len, arg->index);
+      pack_u32(buf, size, &len, arg->times_set);
+      pack_u32(buf, size, &len, arg->values_length);
+      for(i = 0; i < arg->values_length; i++) {
+        pack_u32(buf, size, &len, arg->positions[i]);
+        pack_u32(buf, size, &len, strlen(cli_arg_value(arg, i)));
+      }
+    }
+  }
+
+  pack_u32(buf, size, &len, list->argc);
+  for(i = 0; i < list->argc; i++)
+    pack_u32(buf, size, &len, list->argv_positions[i]);
+
+  return len;
+}
+
+/*! Gets a value from a token on the command line by its packed form
+ *
+ *  Values are always a whole token, or the end of one, like the file.txt in
+ *  -ffile.txt.
+ *
+ *  @param [argc] The number of tokens in argv
+ *  @param [argv] The command line that was parsed
+ *  @param [token] The position of the token the value came from
+ *  @param [length] The length of the value
+ *  @return The value, or NULL if it doesn't fit in the command line
+ */
+static const char* unpack_value(int argc, const char** argv,
+  uint32_t token, uint32_t length)
+{
+  size_t token_length;
+
+  if(token >= (uint32_t)argc) return NULL;
+  token_length = strlen(argv[token]);
+  if(length > token_length) return NULL;
+  return argv[token] + token_length - length;
+}
+
+/*! Fills an arg list from a parse result packed by pack_cli_arg_list
+ *
+ *  The list should be fresh or reset, and must have the same arguments as
+ *  the list that was packed.  Values are copied out of argv, as they would be
+ *  by parse_command_line.  The constraints of the list are checked once it
+ *  has been filled in.
+ *
+ *  @param [in,out] [list] The list to fill in
+ *  @param [argc] The number of tokens in argv
+ *  @param [argv] The command line that the packed result came from
+ *  @param [buf] The packed result
+ *  @param [len] The length of buf
+ *  @return True if the packed parse succeeded, false otherwise.  The error of
+ *    a failed parse is copied into list.  An overlay can't be filled in.
+ */
+bool unpack_cli_arg_list(struct cli_arg_list* list, int argc,
+  const char** argv, const char* buf, size_t len)
+{
+  struct cli_arg* arg;
+  const char* value;
+  size_t pos = 0;
+  uint32_t error, message_length, set_count, index, values_length;
+  uint32_t token, length;
+  uint32_t i, j;
+
+  if(! check_not_overlay(list)) return false;
+  if(! unpack_u32(buf, len, &pos, &error)) goto malformed;
+  if(! unpack_u32(buf, len, &pos, &message_length)) goto malformed;
+  if(message_length > len - pos) goto malformed;
+
+  if(error != none) {
+    if(message_length >= OPTBOT_ERROR_MSG_SIZE) goto malformed;
+    list->error = error;
+    memcpy(list->message, buf + pos, message_length);
+    list->message[message_length] = '\0';
+    return false;
+  }
+  pos += message_length;
+
+  if(! unpack_u32(buf, len, &pos, &set_count)) goto malformed;
+  for(i = 0; i < set_count; i++) {
+    if(! unpack_u32(buf, len, &pos, &index)) goto malformed;
+    if(index >= (uint32_t)list->arg_count) goto malformed;
+    arg = list->args[index];
+
+    if(! unpack_u32(buf, len, &pos, (uint32_t*)&arg->times_set))
+      goto malformed;
+    bitset_set(list->seen, index);
+
+    if(! unpack_u32(buf, len, &pos, &values_length)) goto malformed;
+    for(j = 0; j < values_length; j++) {
+      if(! unpack_u32(buf, len, &pos, &token)) goto malformed;
+      if(! unpack_u32(buf, len, &pos, &length)) goto malformed;
+      value = unpack_value(argc, argv, token, length);
+      if(! value) goto malformed;
+      checkmem(add_to_values(list, arg, value, token));
     }
   }
 
+  if(! unpack_u32(buf, len, &pos, &values_length)) goto malformed;
+  for(j = 0; j < values_length; j++) {
+    if(! unpack_u32(buf, len, &pos, &token)) goto malformed;
+    if(token >= (uint32_t)argc) goto malformed;
+    checkmem(add_to_argv(list, argv[token], token));
+  }
+
+  if(! check_constraints(list)) goto error;
+
   return true;
 
+  malformed:
+    error_check(list, false, remote_failed, "Malformed parse result!");
   error:
-    if(list->error == none) {
-      list->error = out_of_memory;
-      list->message = "Failed to allocate memory.";
+    parse_failed(list);
+    return false;
+}
+
+/*! Sets the validator for the values of an argument
+ *
+ *  The validator is run over every value given to the argument by
+ *  validate_cli_arg_list.  It may store a converted form of the value in
+ *  *result, which can then be read with optbot_result.
+ *
+ *  @param [arg] The argument to validate
+ *  @param [validator] The validator to run on each value
+ *  @param [free_result] Frees the results set by validator, or NULL if they
+ *    don't need to be freed
+ *  @param [data] Passed to every call of validator
+ */
+void arg_validator(struct cli_arg* arg, optbot_validator validator,
+  void (*free_result)(void*), void* data)
+{
+  arg->validator = validator;
+  arg->free_result = free_result;
+  arg->validator_data = data;
+}
+
+/* A single value waiting to be validated */
+struct validation_job {
+  struct cli_arg* arg; /* The argument the value belongs to */
+  int value; /* The index of the value in arg */
+  bool valid; /* Did the value pass validation? */
+};
+
+/* The work shared by the threads of a validation stage */
+struct validation_stage {
+  struct validation_job* jobs;
+  int jobs_length;
+  atomic_int next_job; /* The next job that hasn't been claimed */
+};
+
+/*! Runs validation jobs until none are left to claim
+ *
+ *  Every job writes only to its own result slot and valid flag, so the
+ *  threads of a stage never need to lock anything.
+ *
+ *  @param [stage_ptr] The validation_stage to work on
+ *  @return NULL
+ */
+static void* run_validation_jobs(void* stage_ptr) {
+  struct validation_stage* stage = stage_ptr;
+  struct validation_job* job;
+  struct cli_arg* arg;
+  int i;
+
+  while((i = atomic_fetch_add(&stage->next_job, 1)) < stage->jobs_length) {
+    job = &stage->jobs[i];
+    arg = job->arg;
+    job->valid = arg->validator(cli_arg_value(arg, job->value),
+      &arg->results[job->value], arg->validator_data);
+  }
+
+  return NULL;
+}
+
+/*! Orders invalid values by their position on the command line
+ *
+ *  @param [a] A struct optbot_invalid
+ *  @param [b] Another struct optbot_invalid
+ *  @return Less than, equal to, or greater than 0 as a comes before, at, or
+ *    after b
+ */
+static int compare_invalid(const void* a, const void* b) {
+  return ((const struct optbot_invalid*)a)->position -
+    ((const struct optbot_invalid*)b)->position;
+}
+
+/*! Runs the validators of a parsed list over all of their values
+ *
+ *  Values can be spread over a fixed number of worker threads.  Results are
+ *  stored for each value and can be read with optbot_result.  Every invalid
+ *  value is listed in the list's invalid field in command line order, and
+ *  the earliest is reported as the error, regardless of how the work was
+ *  spread over the threads.
+ *
+ *  @param [list] The list to validate.  This should already be parsed.
+ *  @param [workers] The number of threads to validate with.  With 1 or
+ *    less, validation happens on the calling thread only.
+ *  @return True if every value is valid, false otherwise
+ */
+bool validate_cli_arg_list(struct cli_arg_list* list, int workers) {
+  char name[OPTBOT_ERROR_MSG_SIZE / 4];
+  struct validation_stage stage;
+  struct validation_job* job;
+  struct optbot_invalid* invalid;
+  struct cli_arg* arg;
+  /* An overlay only validates its overrides, never its base */
+  struct cli_arg** args = list->base ? list->touched : list->args;
+  int arg_count = list->base ? list->touched_length : list->arg_count;
+  pthread_t* threads = NULL;
+  int threads_length = 0;
+  int jobs_size = 0;
+  int i;
+  int j;
+
+  stage.jobs = NULL;
+  stage.jobs_length = 0;
+  atomic_init(&stage.next_job, 0);
+
+  free(list->invalid);
+  list->invalid = NULL;
+  list->invalid_length = 0;
+
+  for(i = 0; i < arg_count; i++) {
+    arg = args[i];
+    clear_results(arg);
+    if(! arg->validator || ! arg->values_length) continue;
+
+    arg->results = calloc(arg->values_length, sizeof(void*));
+    checkmem(arg->results);
+    jobs_size += arg->values_length;
+  }
+
+  if(! jobs_size) return true;
+
+  stage.jobs = malloc(sizeof(struct validation_job) * jobs_size);
+  checkmem(stage.jobs);
+
+  for(i = 0; i < arg_count; i++) {
+    arg = args[i];
+    if(! arg->results) continue;
+
+    for(j = 0; j < arg->values_length; j++) {
+      stage.jobs[stage.jobs_length].arg = arg;
+      stage.jobs[stage.jobs_length].value = j;
+      stage.jobs_length++;
+    }
+  }
+
+  /* The calling thread works through the jobs along with the pool, so a
+     thread that can't be started just means less parallelism. */
+  if(workers > 1) {
+    threads = malloc(sizeof(pthread_t) * (workers - 1));
+    checkmem(threads);
+
+    while(threads_length < workers - 1 && threads_length < stage.jobs_length) {
+      if(pthread_create(&threads[threads_length], NULL,
+        run_validation_jobs, &stage) != 0) break;
+      threads_length++;
+    }
+  }
+
+  run_validation_jobs(&stage);
+  for(i = 0; i < threads_length; i++)
+    pthread_join(threads[i], NULL);
+
+  for(i = 0; i < stage.jobs_length; i++)
+    if(! stage.jobs[i].valid) list->invalid_length++;
+
+  if(list->invalid_length) {
+    list->invalid = malloc(sizeof(struct optbot_invalid) *
+      list->invalid_length);
+    if(! list->invalid) list->invalid_length = 0;
+    checkmem(list->invalid);
+
+    invalid = list->invalid;
+    for(i = 0; i < stage.jobs_length; i++) {
+      job = &stage.jobs[i];
+      if(job->valid) continue;
+      invalid->handle = job->arg->index;
+      invalid->value = job->value;
+      invalid->position = job->arg->positions[job->value];
+      invalid++;
     }
+    qsort(list->invalid, list->invalid_length, sizeof(struct optbot_invalid),
+      compare_invalid);
+  }
+
+  error_check(list, (! list->invalid_length), invalid_value,
+    "%s was given an invalid value: %s",
+    arg_name(handle_arg(list, list->invalid[0].handle), name, sizeof(name)),
+    optbot_value(list, list->invalid[0].handle, list->invalid[0].value));
+
+  free(stage.jobs);
+  free(threads);
+  return true;
+
+  error:
+    free(stage.jobs);
+    free(threads);
+    parse_failed(list);
     return false;
 }
 
+/*! Gets the result of validating a value by the handle of its argument
+ *
+ *  @param [list] The list the argument belongs to
+ *  @param [handle] The handle of the argument
+ *  @param [i] The index of the value
+ *  @return The result the validator stored for the value, or NULL if the
+ *    value hasn't been validated or its validator stored nothing
+ */
+void* optbot_result(const struct cli_arg_list* list, int handle, int i) {
+  const struct cli_arg* arg = handle_arg(list, handle);
+  return arg->results && i < arg->values_length ? arg->results[i] : NULL;
+}
+
 /*! Prints help to stderr
  *
  *  @param [list] The argument list to print
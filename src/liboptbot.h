@@ -2,6 +2,7 @@
 #define __ARG_LIST_INC__
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 
 // Some basic error handling tools
@@ -13,6 +14,17 @@
 #define checkmem(obj) \
   if(!obj) { errmsg("You're out of memory hoss!"); goto error; }
 
+/* liboptbot can be built into a program by defining OPTBOT_IMPLEMENTATION
+ * before including this header in one source file.  Defining OPTBOT_STATIC
+ * as well gives every function internal linkage, so that the compiler is
+ * free to inline and specialize them at their call sites.
+ */
+#if defined(OPTBOT_IMPLEMENTATION) && defined(OPTBOT_STATIC)
+#define OPTBOT_API static __attribute__((unused))
+#else
+#define OPTBOT_API
+#endif
+
 #define OPTBOT_ERROR_MSG_SIZE 512
 
 /* For simplified error reporting.  Requires an error goto.
@@ -29,6 +41,18 @@
 
 #define ARRAY_INIT_SIZE 10
 
+/* The number of bits in a word of an option bitset */
+#define OPTBOT_WORD_BITS (sizeof(unsigned long) * 8)
+
+/*! Validates, and optionally converts, a value given to an argument
+ *
+ *  @param [value] The value to validate
+ *  @param [out] [result] Where a converted form of the value may be stored
+ *  @param [data] The data given to arg_validator
+ *  @return Is the value valid?
+ */
+typedef bool (*optbot_validator)(const char* value, void** result, void* data);
+
 /*! A command line argument */
 struct cli_arg {
   char* description; /* A brief description of this argument */
@@ -36,10 +60,28 @@ struct cli_arg {
   char little; /* The short option that this argument takes */
   bool takes_value; /* Does this argument take a value? */
   bool allow_multiple; /* Can this argument be set multiple times? */
+  bool required; /* Must this argument be given? Set with arg_required */
+  int max_times; /* The most times this can be set, or 0 for no limit */
+  int index; /* The position of this argument in its list */
+  int constraint_words; /* The number of words in conflicts and requires */
+  unsigned long* conflicts; /* Bitset of arguments this can't be used with */
+  unsigned long* requires; /* Bitset of arguments this must be used with */
   int times_set; /* The number of times this option was set */
   int values_length; /* The number of values held in values */
   int values_size; /* The number of values allocated in values */
   char** values; /* The value that have been assigned to this argument */
+  bool packed; /* Are values kept in pool instead?  Set with arg_packed */
+  char* pool; /* The values back to back, NUL-terminated, when packed */
+  size_t pool_length; /* The number of bytes used in pool */
+  size_t pool_size; /* The number of bytes allocated in pool */
+  uint32_t* offsets; /* The offset in pool of each value, when packed */
+  int* positions; /* The position on the command line of each value */
+  optbot_validator validator; /* Validates values, set with arg_validator */
+  void (*free_result)(void*); /* Frees the results set by validator */
+  void* validator_data; /* Passed to validator */
+  void** results; /* The results of validation for each value */
+  bool from_spec; /* Is this argument part of its list's spec? */
+  const struct cli_arg* base; /* The argument this overrides in an overlay */
 };
 
 /* User error types */
@@ -50,11 +92,49 @@ enum cli_arg_error {
   value_required, /* An  which requires a value was not given one */
   empty_list, /* An empty argument list was given where it is not allowed */
   out_of_memory, /* Internal object initialization failed */
+  bad_buffer, /* A command buffer was not NUL-terminated */
+  missing_required, /* A required option was not given */
+  conflicting_opts, /* Two options that conflict were both given */
+  missing_dependency, /* An option was given without one that it requires */
+  invalid_value, /* A value was rejected by its argument's validator */
+  remote_failed, /* A parse could not be done or read back from optbotd */
+  overlay_read_only, /* An overlay was asked to change its base's arguments */
 };
 
-struct cli_arg* init_cli_arg(void);
-void destroy_cli_arg(struct cli_arg*);
-void print_cli_arg(struct cli_arg*);
+OPTBOT_API struct cli_arg* init_cli_arg(void);
+OPTBOT_API void destroy_cli_arg(struct cli_arg*);
+OPTBOT_API void print_cli_arg(struct cli_arg*);
+OPTBOT_API bool arg_packed(struct cli_arg*);
+OPTBOT_API const char* cli_arg_value(const struct cli_arg*, int);
+
+/*! An argument in a spec */
+struct optbot_spec_arg {
+  char little; /* The short option, or '\0' for none */
+  const char* big; /* The long option sans dashes, or NULL for none */
+  const char* description; /* A brief description of this argument */
+  bool takes_value; /* Does this argument take a value? */
+  int max_times; /* The most times this can be set, or 0 for no limit */
+};
+
+/*! A fixed set of arguments, usually generated by optbotgen
+ *
+ *  The lookup functions return the index of the matching argument in args,
+ *  or -1 if there is none.
+ */
+struct optbot_spec {
+  const char* name; /* The name of the spec */
+  int arg_count; /* The number of arguments in args */
+  const struct optbot_spec_arg* args; /* The arguments, by index */
+  int (*find_little)(char); /* Looks an argument up by its short option */
+  int (*find_big)(const char*); /* Looks an argument up by its long option */
+};
+
+/*! A value rejected by validate_cli_arg_list */
+struct optbot_invalid {
+  int handle; /* The handle of the argument the value was given to */
+  int value; /* The index of the value among the argument's values */
+  int position; /* The position of the value on the command line */
+};
 
 struct cli_arg_list_node {
   struct cli_arg* arg;
@@ -65,7 +145,25 @@ struct cli_arg_list {
   int argc; /* The number of positional params left over after parsing */
   char** argv; /* The positional params left over after parsing */
   int argv_size;
+  int* argv_positions; /* The position on the command line of each param */
   struct cli_arg_list_node* head;
+  struct cli_arg** args; /* The arguments in the list, by index */
+  int arg_count; /* The number of arguments in args */
+  int args_size; /* The number of arguments allocated in args */
+  int bitset_words; /* The number of words in each bitset of the list */
+  unsigned long* seen; /* Bitset of the arguments that have been set */
+  unsigned long* required; /* Bitset of the arguments that must be set */
+  unsigned long* changed; /* Bitset of the arguments changed by a re-parse */
+  bool argv_changed; /* Did the last re-parse change the leftover params? */
+  bool borrowing; /* Do values point into argv rather than being copied? */
+  const struct optbot_spec* spec; /* The spec the list was made from */
+  const struct cli_arg_list* base; /* The list this overlays, or NULL */
+  struct cli_arg** touched; /* The arguments an overlay has overridden */
+  int touched_length; /* The number of arguments in touched */
+  int touched_size; /* The number of arguments allocated in touched */
+  struct optbot_invalid* invalid; /* Values rejected by the last
+                                     validation, in command line order */
+  int invalid_length; /* The number of values in invalid */
   enum cli_arg_error error; /* The last error that occured */
   bool devour_flag; /* enables the -- option */
   char* message; /* An error string for the last error that occured */
@@ -73,16 +171,51 @@ struct cli_arg_list {
 
 enum arg_type {little, big};
 
-struct cli_arg_list* init_cli_arg_list(void);
-void destroy_cli_arg_list(struct cli_arg_list*);
-void print_cli_arg_list(struct cli_arg_list*);
+OPTBOT_API struct cli_arg_list* init_cli_arg_list(void);
+OPTBOT_API struct cli_arg_list* init_cli_arg_list_spec(
+  const struct optbot_spec*);
+OPTBOT_API struct cli_arg_list* init_cli_arg_list_overlay(
+  const struct cli_arg_list*);
+OPTBOT_API void destroy_cli_arg_list(struct cli_arg_list*);
+OPTBOT_API void print_cli_arg_list(struct cli_arg_list*);
+
+OPTBOT_API struct cli_arg* big_opt_arg(struct cli_arg_list*, const char*);
+OPTBOT_API struct cli_arg* little_opt_arg(const struct cli_arg_list*, char);
+OPTBOT_API struct cli_arg* add_arg(struct cli_arg_list*, char, const char*,
+  const char*, bool);
+OPTBOT_API bool parse_command_line(struct cli_arg_list*, int, const char**);
+OPTBOT_API bool parse_command_buffer(struct cli_arg_list*, const char*, size_t);
+OPTBOT_API void reset_cli_arg_list(struct cli_arg_list*);
+OPTBOT_API bool reparse_command_line(struct cli_arg_list*, int, const char**);
 
-struct cli_arg* big_opt_arg(struct cli_arg_list*, const char*);
-struct cli_arg* little_opt_arg(const struct cli_arg_list*, char);
-bool add_arg(struct cli_arg_list*, char, const char*, const char*, bool);
-bool parse_command_line(struct cli_arg_list*, int, const char**);
+OPTBOT_API struct cli_arg* optbot_arg(const struct cli_arg_list*, int);
+OPTBOT_API int optbot_count(const struct cli_arg_list*, int);
+OPTBOT_API int optbot_values_length(const struct cli_arg_list*, int);
+OPTBOT_API const char* optbot_value(const struct cli_arg_list*, int, int);
+OPTBOT_API bool optbot_changed(const struct cli_arg_list*, int);
 
-void print_help(struct cli_arg_list*);
-void write_help(struct cli_arg_list*, FILE*);
+OPTBOT_API bool arg_required(struct cli_arg_list*, struct cli_arg*);
+OPTBOT_API void arg_max_times(struct cli_arg*, int);
+OPTBOT_API bool arg_conflicts(struct cli_arg_list*, struct cli_arg*,
+  struct cli_arg*);
+OPTBOT_API bool arg_requires(struct cli_arg_list*, struct cli_arg*,
+  struct cli_arg*);
+
+OPTBOT_API void arg_validator(struct cli_arg*, optbot_validator,
+  void (*)(void*), void*);
+OPTBOT_API bool validate_cli_arg_list(struct cli_arg_list*, int);
+OPTBOT_API void* optbot_result(const struct cli_arg_list*, int, int);
+
+OPTBOT_API size_t pack_cli_arg_list(const struct cli_arg_list*, char*,
+  size_t);
+OPTBOT_API bool unpack_cli_arg_list(struct cli_arg_list*, int, const char**,
+  const char*, size_t);
+
+OPTBOT_API void print_help(struct cli_arg_list*);
+OPTBOT_API void write_help(struct cli_arg_list*, FILE*);
+
+#ifdef OPTBOT_IMPLEMENTATION
+#include "liboptbot.c"
+#endif
 
 #endif
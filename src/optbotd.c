@@ -0,0 +1,667 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "optbotd.h"
+
+/* A list of client sockets */
+struct fd_list {
+  int* fds;
+  int length;
+  int size;
+};
+
+/*! A running optbotd server
+ *
+ *  The dispatcher thread polls the listener and the idle clients.  A client
+ *  with a request waiting is queued, a worker takes it off the queue, serves
+ *  that one request, and returns it to the dispatcher.
+ */
+struct optbotd {
+  char* path; /* The path of the socket */
+  int listener; /* The listening socket */
+  bool bound; /* Was the socket created at path? */
+  int wake[2]; /* A pipe that wakes the dispatcher when written to */
+  const struct optbot_spec* const* specs; /* The specs that can be parsed */
+  int spec_count; /* The number of specs in specs */
+  pthread_t dispatcher; /* The dispatcher thread */
+  bool dispatching; /* Was the dispatcher started? */
+  pthread_t* workers; /* The worker threads */
+  int workers_length; /* The number of threads in workers */
+  struct fd_list idle; /* Clients the dispatcher polls, its own */
+  pthread_mutex_t lock; /* Guards everything below */
+  pthread_cond_t queued; /* Signalled when a client is queued */
+  struct fd_list queue; /* Clients with a request waiting, oldest first */
+  struct fd_list busy; /* Clients being served */
+  struct fd_list returned; /* Served clients to go back to the dispatcher */
+  bool stopping; /* Has optbotd_stop been called? */
+};
+
+/*! Reads exactly len bytes from a socket
+ *
+ *  @param [fd] The socket to read from
+ *  @param [out] [buf] The buffer to read into
+ *  @param [len] The number of bytes to read
+ *  @return False if the socket closed or failed first
+ */
+static bool read_all(int fd, void* buf, size_t len) {
+  ssize_t got;
+
+  while(len > 0) {
+    got = read(fd, buf, len);
+    if(got < 0 && errno == EINTR) continue;
+    if(got <= 0) return false;
+    buf = (char*)buf + got;
+    len -= got;
+  }
+
+  return true;
+}
+
+/*! Writes exactly len bytes to a socket
+ *
+ *  @param [fd] The socket to write to
+ *  @param [buf] The bytes to write
+ *  @param [len] The number of bytes to write
+ *  @return False if the socket failed first
+ */
+static bool write_all(int fd, const void* buf, size_t len) {
+  ssize_t put;
+
+  while(len > 0) {
+    put = send(fd, buf, len, MSG_NOSIGNAL);
+    if(put < 0 && errno == EINTR) continue;
+    if(put <= 0) return false;
+    buf = (const char*)buf + put;
+    len -= put;
+  }
+
+  return true;
+}
+
+/*! Reads a length-prefixed frame from a socket
+ *
+ *  @param [fd] The socket to read from
+ *  @param [in,out] [buf] The address of the buffer to read into, which is
+ *    grown as needed
+ *  @param [in,out] [size] The size of *buf
+ *  @param [out] [len] The length of the frame
+ *  @return False if the socket closed or the frame couldn't be read
+ */
+static bool read_frame(int fd, char** buf, size_t* size, uint32_t* len) {
+  char* grown;
+
+  if(! read_all(fd, len, sizeof(*len))) return false;
+  if(*len > OPTBOTD_MAX_FRAME) return false;
+
+  if(*len > *size) {
+    grown = realloc(*buf, *len);
+    checkmem(grown);
+    *buf = grown;
+    *size = *len;
+  }
+
+  return read_all(fd, *buf, *len);
+
+  error:
+    return false;
+}
+
+/*! Packs a response for a request naming a spec the server doesn't have
+ *
+ *  @param [name] The name of the spec that was asked for
+ *  @param [in,out] [response] The address of the buffer to pack the
+ *    response into, which is grown as needed
+ *  @param [in,out] [size] The size of *response
+ *  @return The length of the response, including its length, or 0 if it
+ *    couldn't be packed
+ */
+static size_t unknown_spec(const char* name, char** response, size_t* size) {
+  char message[OPTBOT_ERROR_MSG_SIZE];
+  uint32_t fields[3];
+  char* grown;
+
+  fields[1] = remote_failed;
+  fields[2] = snprintf(message, sizeof(message) - 1,
+    "optbotd doesn't have a spec named %s!", name);
+  if(fields[2] >= sizeof(message) - 1) fields[2] = sizeof(message) - 2;
+  fields[0] = sizeof(fields) - sizeof(fields[0]) + fields[2];
+
+  if(sizeof(fields) + fields[2] > *size) {
+    grown = realloc(*response, sizeof(fields) + fields[2]);
+    if(! grown) return 0;
+    *response = grown;
+    *size = sizeof(fields) + fields[2];
+  }
+  memcpy(*response, fields, sizeof(fields));
+  memcpy(*response + sizeof(fields), message, fields[2]);
+
+  return sizeof(fields) + fields[2];
+}
+
+/*! Parses one request on behalf of a client
+ *
+ *  @param [server] The server the request came to
+ *  @param [lists] The worker's list for each spec
+ *  @param [request] The request, without its length
+ *  @param [len] The length of request
+ *  @param [in,out] [response] The address of the buffer to pack the
+ *    response into, after room for its length.  It's grown as needed.
+ *  @param [in,out] [size] The size of *response
+ *  @return The length of the response, including its length, or 0 if the
+ *    request couldn't be served
+ */
+static size_t serve_request(struct optbotd* server,
+  struct cli_arg_list** lists, const char* request, uint32_t len,
+  char** response, size_t* size)
+{
+  struct cli_arg_list* list = NULL;
+  const char* name = request + sizeof(uint32_t);
+  const char* end = request + len;
+  const char* tokens;
+  uint32_t flags;
+  uint32_t packed;
+  char* grown;
+  int i;
+
+  if(len < sizeof(flags) + 1 || end[-1] != '\0') return 0;
+  memcpy(&flags, request, sizeof(flags));
+
+  for(i = 0; i < server->spec_count; i++) {
+    if(strcmp(server->specs[i]->name, name) == 0) list = lists[i];
+  }
+  if(! list) return unknown_spec(name, response, size);
+
+  tokens = name + strlen(name) + 1;
+  reset_cli_arg_list(list);
+  list->devour_flag = flags & OPTBOTD_DEVOUR;
+  parse_command_buffer(list, tokens, end - tokens);
+
+  packed = pack_cli_arg_list(list, *response + sizeof(packed),
+    *size - sizeof(packed));
+  if(packed + sizeof(packed) > *size) {
+    grown = realloc(*response, packed + sizeof(packed));
+    if(! grown) return 0;
+    *response = grown;
+    *size = packed + sizeof(packed);
+    pack_cli_arg_list(list, *response + sizeof(packed), packed);
+  }
+  memcpy(*response, &packed, sizeof(packed));
+
+  return packed + sizeof(packed);
+}
+
+/*! Adds a socket to a list of sockets
+ *
+ *  @param [list] The list to add to
+ *  @param [fd] The socket to add
+ *  @return Was the operation successful?
+ */
+static bool fd_list_push(struct fd_list* list, int fd) {
+  int* grown;
+
+  if(list->length == list->size) {
+    grown = realloc(list->fds, sizeof(int) * (list->size + 16));
+    checkmem(grown);
+    list->fds = grown;
+    list->size += 16;
+  }
+  list->fds[list->length++] = fd;
+
+  return true;
+
+  error:
+    return false;
+}
+
+/*! Removes a socket from a list of sockets, keeping the rest in order
+ *
+ *  @param [list] The list to remove from
+ *  @param [fd] The socket to remove
+ */
+static void fd_list_remove(struct fd_list* list, int fd) {
+  int i;
+
+  for(i = 0; i < list->length; i++) {
+    if(list->fds[i] != fd) continue;
+    memmove(&list->fds[i], &list->fds[i + 1],
+      sizeof(int) * (list->length - i - 1));
+    list->length--;
+    return;
+  }
+}
+
+/*! Closes every socket in a list and frees it
+ *
+ *  @param [list] The list to close
+ */
+static void fd_list_close(struct fd_list* list) {
+  int i;
+
+  for(i = 0; i < list->length; i++)
+    close(list->fds[i]);
+  free(list->fds);
+  list->fds = NULL;
+  list->length = list->size = 0;
+}
+
+/*! Wakes the dispatcher so that it notices returned clients or a stop
+ *
+ *  @param [server] The server to wake
+ */
+static void wake_dispatcher(struct optbotd* server) {
+  char byte = 0;
+  ssize_t put;
+
+  /* A full pipe already has a wake up waiting in it */
+  do put = write(server->wake[1], &byte, 1);
+  while(put < 0 && errno == EINTR);
+}
+
+/*! Accepts a new client and starts watching it for requests
+ *
+ *  @param [server] The server to accept for
+ */
+static void accept_client(struct optbotd* server) {
+  struct timeval timeout = {OPTBOTD_TIMEOUT, 0};
+  int client = accept(server->listener, NULL, NULL);
+
+  if(client < 0) return;
+
+  /* A client that stops partway through a request can't hold a worker */
+  setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+  if(! fd_list_push(&server->idle, client)) close(client);
+}
+
+/*! Watches the listener and idle clients, queueing clients that send a
+ *  request for the workers
+ *
+ *  Workers are only handed a client for one request at a time, so clients
+ *  that keep a connection open without using it don't tie up the pool.
+ *
+ *  @param [server_ptr] The struct optbotd to dispatch for
+ *  @return NULL
+ */
+static void* run_dispatcher(void* server_ptr) {
+  struct optbotd* server = server_ptr;
+  struct pollfd* polled = NULL;
+  struct pollfd* grown;
+  int polled_size = 0;
+  int polled_length;
+  char drain[64];
+  int i;
+
+  for(;;) {
+    if(server->idle.length + 2 > polled_size) {
+      grown = realloc(polled, sizeof(struct pollfd) *
+        (server->idle.length + 2));
+      if(! grown) break;
+      polled = grown;
+      polled_size = server->idle.length + 2;
+    }
+
+    polled[0].fd = server->wake[0];
+    polled[1].fd = server->listener;
+    for(i = 0; i < server->idle.length; i++)
+      polled[i + 2].fd = server->idle.fds[i];
+    polled_length = server->idle.length + 2;
+    for(i = 0; i < polled_length; i++)
+      polled[i].events = POLLIN;
+
+    if(poll(polled, polled_length, -1) < 0) {
+      if(errno == EINTR) continue;
+      break;
+    }
+
+    pthread_mutex_lock(&server->lock);
+    if(server->stopping) {
+      pthread_mutex_unlock(&server->lock);
+      break;
+    }
+
+    if(polled[0].revents) {
+      while(read(server->wake[0], drain, sizeof(drain)) == sizeof(drain));
+      for(i = 0; i < server->returned.length; i++) {
+        if(! fd_list_push(&server->idle, server->returned.fds[i]))
+          close(server->returned.fds[i]);
+      }
+      server->returned.length = 0;
+    }
+
+    /* A client with something to read has a request waiting, or has hung
+       up, which the worker will find out */
+    for(i = 2; i < polled_length; i++) {
+      if(! polled[i].revents) continue;
+      fd_list_remove(&server->idle, polled[i].fd);
+      if(! fd_list_push(&server->queue, polled[i].fd))
+        close(polled[i].fd);
+      pthread_cond_signal(&server->queued);
+    }
+    pthread_mutex_unlock(&server->lock);
+
+    if(polled[1].revents) accept_client(server);
+  }
+
+  free(polled);
+  return NULL;
+}
+
+/*! Serves requests from clients handed over by the dispatcher until the
+ *  server stops
+ *
+ *  Every worker has its own resident list for each spec, which is reset
+ *  between requests, so nothing is shared between workers but the queue of
+ *  clients.
+ *
+ *  @param [server_ptr] The struct optbotd to work for
+ *  @return NULL
+ */
+static void* run_worker(void* server_ptr) {
+  struct optbotd* server = server_ptr;
+  struct cli_arg_list** lists;
+  char* request = NULL;
+  char* response = NULL;
+  size_t request_size = 0;
+  size_t response_size = 0;
+  size_t response_length;
+  uint32_t len;
+  bool served;
+  int client;
+  int i;
+
+  lists = calloc(server->spec_count, sizeof(struct cli_arg_list*));
+  if(! lists) return NULL;
+  for(i = 0; i < server->spec_count; i++) {
+    lists[i] = init_cli_arg_list_spec(server->specs[i]);
+    if(! lists[i]) goto done;
+  }
+
+  response_size = sizeof(uint32_t) * 64;
+  response = malloc(response_size);
+  if(! response) goto done;
+
+  for(;;) {
+    pthread_mutex_lock(&server->lock);
+    while(! server->queue.length && ! server->stopping)
+      pthread_cond_wait(&server->queued, &server->lock);
+    if(server->stopping) {
+      pthread_mutex_unlock(&server->lock);
+      break;
+    }
+    client = server->queue.fds[0];
+    fd_list_remove(&server->queue, client);
+    /* Only fails for lack of memory, in which case stopping can't wake
+       this worker early and has to wait out the timeout */
+    fd_list_push(&server->busy, client);
+    pthread_mutex_unlock(&server->lock);
+
+    served = read_frame(client, &request, &request_size, &len);
+    if(served) {
+      response_length = serve_request(server, lists, request, len,
+        &response, &response_size);
+      served = response_length &&
+        write_all(client, response, response_length);
+    }
+
+    /* The client is closed under the lock so that optbotd_stop never shuts
+       down a socket number that has been reused */
+    pthread_mutex_lock(&server->lock);
+    fd_list_remove(&server->busy, client);
+    if(served && ! server->stopping && fd_list_push(&server->returned, client))
+      wake_dispatcher(server);
+    else
+      close(client);
+    pthread_mutex_unlock(&server->lock);
+  }
+
+  done:
+    for(i = 0; i < server->spec_count; i++)
+      if(lists[i]) destroy_cli_arg_list(lists[i]);
+    free(lists);
+    free(request);
+    free(response);
+    return NULL;
+}
+
+/*! Starts an optbotd server
+ *
+ *  @param [path] The path to create the server's socket at.  Anything
+ *    already there is removed.
+ *  @param [specs] The specs that clients can parse with.  These, and the
+ *    array itself, must outlive the server.
+ *  @param [spec_count] The number of specs in specs
+ *  @param [workers] The number of worker threads to serve with
+ *  @return The running server, or NULL if it could not be started
+ */
+struct optbotd* optbotd_start(const char* path,
+  const struct optbot_spec* const* specs, int spec_count, int workers)
+{
+  struct optbotd* server;
+  struct sockaddr_un addr;
+
+  if(strlen(path) >= sizeof(addr.sun_path) || workers < 1) return NULL;
+
+  server = calloc(1, sizeof(struct optbotd));
+  checkmem(server);
+  server->listener = -1;
+  server->wake[0] = server->wake[1] = -1;
+  server->specs = specs;
+  server->spec_count = spec_count;
+  pthread_mutex_init(&server->lock, NULL);
+  pthread_cond_init(&server->queued, NULL);
+
+  server->path = strdup(path);
+  checkmem(server->path);
+  server->workers = malloc(sizeof(pthread_t) * workers);
+  checkmem(server->workers);
+
+  if(pipe(server->wake) != 0) goto error;
+  fcntl(server->wake[0], F_SETFL, O_NONBLOCK);
+  fcntl(server->wake[1], F_SETFL, O_NONBLOCK);
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+
+  server->listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  if(server->listener < 0) goto error;
+  /* poll can report a connection that's gone by the time it's accepted */
+  fcntl(server->listener, F_SETFL, O_NONBLOCK);
+  unlink(path);
+  if(bind(server->listener, (struct sockaddr*)&addr, sizeof(addr)) != 0)
+    goto error;
+  server->bound = true;
+  if(listen(server->listener, SOMAXCONN) != 0) goto error;
+
+  while(server->workers_length < workers) {
+    if(pthread_create(&server->workers[server->workers_length], NULL,
+      run_worker, server) != 0) break;
+    server->workers_length++;
+  }
+  if(! server->workers_length) goto error;
+
+  if(pthread_create(&server->dispatcher, NULL, run_dispatcher, server) != 0)
+    goto error;
+  server->dispatching = true;
+
+  return server;
+
+  error:
+    if(server) optbotd_stop(server);
+    return NULL;
+}
+
+/*! Stops an optbotd server and frees it
+ *
+ *  Open connections are shut down, so a request that's partway through is
+ *  cut off rather than waited for.
+ *
+ *  @param [server] The server to stop
+ */
+void optbotd_stop(struct optbotd* server) {
+  int i;
+
+  pthread_mutex_lock(&server->lock);
+  server->stopping = true;
+  /* Wakes up workers blocked on their clients */
+  for(i = 0; i < server->busy.length; i++)
+    shutdown(server->busy.fds[i], SHUT_RDWR);
+  pthread_cond_broadcast(&server->queued);
+  pthread_mutex_unlock(&server->lock);
+
+  if(server->dispatching) {
+    wake_dispatcher(server);
+    pthread_join(server->dispatcher, NULL);
+  }
+  for(i = 0; i < server->workers_length; i++)
+    pthread_join(server->workers[i], NULL);
+
+  fd_list_close(&server->idle);
+  fd_list_close(&server->queue);
+  fd_list_close(&server->returned);
+  free(server->busy.fds);
+
+  if(server->listener >= 0) close(server->listener);
+  if(server->bound) unlink(server->path);
+  if(server->wake[0] >= 0) close(server->wake[0]);
+  if(server->wake[1] >= 0) close(server->wake[1]);
+  pthread_mutex_destroy(&server->lock);
+  pthread_cond_destroy(&server->queued);
+
+  free(server->workers);
+  free(server->path);
+  free(server);
+}
+
+/*! Connects to an optbotd server
+ *
+ *  The connection can be used for any number of parses with
+ *  parse_command_line_remote_fd, and should be closed when done.
+ *
+ *  @param [path] The path of the server's socket
+ *  @return The connected socket, or -1 if the connection failed
+ */
+int optbotd_connect(const char* path) {
+  struct sockaddr_un addr;
+  int fd;
+
+  if(strlen(path) >= sizeof(addr.sun_path)) return -1;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+
+  fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if(fd < 0) return -1;
+  if(connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+/*! Parses a command line on an optbotd server over an open connection
+ *
+ *  This stands in for parse_command_line.  The list must have been made
+ *  with init_cli_arg_list_spec, from a spec with the same name and
+ *  arguments as one the server was started with.
+ *
+ *  @param [in,out] [list] The argument list that will be populated
+ *  @param [fd] A connection made with optbotd_connect
+ *  @param [argc] The number of string arguments contained in argv
+ *  @param [argv] An array of command line arguments
+ *  @return True if the arguments were parsed successfully, false otherwise
+ */
+bool parse_command_line_remote_fd(struct cli_arg_list* list, int fd,
+  int argc, const char** argv)
+{
+  char* buf = NULL;
+  size_t size = 0;
+  size_t name_length;
+  size_t len;
+  uint32_t flags = list->devour_flag ? OPTBOTD_DEVOUR : 0;
+  uint32_t frame;
+  int i;
+
+  error_check(list, list->spec, remote_failed,
+    "Only lists made from a spec can be parsed remotely!");
+
+  name_length = strlen(list->spec->name) + 1;
+  len = sizeof(frame) + sizeof(flags) + name_length;
+  for(i = 0; i < argc; i++)
+    len += strlen(argv[i]) + 1;
+  error_check(list, (len - sizeof(frame) <= OPTBOTD_MAX_FRAME),
+    remote_failed, "The command line is too long to parse remotely!");
+
+  buf = malloc(len);
+  checkmem(buf);
+  size = len;
+
+  frame = len - sizeof(frame);
+  memcpy(buf, &frame, sizeof(frame));
+  memcpy(buf + sizeof(frame), &flags, sizeof(flags));
+  len = sizeof(frame) + sizeof(flags);
+  memcpy(buf + len, list->spec->name, name_length);
+  len += name_length;
+  for(i = 0; i < argc; i++) {
+    name_length = strlen(argv[i]) + 1;
+    memcpy(buf + len, argv[i], name_length);
+    len += name_length;
+  }
+
+  error_check(list, (write_all(fd, buf, len) &&
+    read_frame(fd, &buf, &size, &frame)), remote_failed,
+    "Lost the connection to optbotd!");
+
+  if(! unpack_cli_arg_list(list, argc, argv, buf, frame)) goto error;
+
+  free(buf);
+  return true;
+
+  error:
+    free(buf);
+    if(list->error == none) {
+      list->error = out_of_memory;
+      snprintf(list->message, OPTBOT_ERROR_MSG_SIZE - 1,
+        "Failed to allocate memory.");
+    }
+    return false;
+}
+
+/*! Parses a command line on an optbotd server
+ *
+ *  This connects to the server, parses with parse_command_line_remote_fd,
+ *  and disconnects.
+ *
+ *  @param [in,out] [list] The argument list that will be populated
+ *  @param [path] The path of the server's socket
+ *  @param [argc] The number of string arguments contained in argv
+ *  @param [argv] An array of command line arguments
+ *  @return True if the arguments were parsed successfully, false otherwise
+ */
+bool parse_command_line_remote(struct cli_arg_list* list, const char* path,
+  int argc, const char** argv)
+{
+  int fd = optbotd_connect(path);
+  bool parsed;
+
+  error_check(list, (fd >= 0), remote_failed,
+    "Couldn't connect to optbotd at %s!", path);
+
+  parsed = parse_command_line_remote_fd(list, fd, argc, argv);
+  close(fd);
+  return parsed;
+
+  error:
+    return false;
+}
@@ -0,0 +1,41 @@
+#ifndef __OPTBOTD_INC__
+#define __OPTBOTD_INC__
+
+#include "liboptbot.h"
+
+/* optbotd keeps lists built from specs resident in a server, and parses
+ * command lines sent to it over a Unix domain socket with a pool of worker
+ * threads.  Workers are handed one request at a time, so clients can keep
+ * connections open between requests without tying them up.  Clients get
+ * back a packed result (see pack_cli_arg_list) which is unpacked into a list
+ * made from the same spec.
+ *
+ * A request is a native 32 bit length followed by that many bytes: a 32 bit
+ * flags word, the NUL-terminated name of the spec, and then each token of
+ * the command line, NUL-terminated.  A response is a 32 bit length followed
+ * by the packed result.
+ */
+
+/* Set in the flags of a request when the client's list has devour_flag set */
+#define OPTBOTD_DEVOUR 0x1
+
+/* The largest request or response that will be read */
+#define OPTBOTD_MAX_FRAME (1 << 24)
+
+/* The seconds a client may take to finish sending a request, or to read
+   its response, before the server hangs up on it */
+#define OPTBOTD_TIMEOUT 5
+
+struct optbotd;
+
+struct optbotd* optbotd_start(const char*, const struct optbot_spec* const*,
+  int, int);
+void optbotd_stop(struct optbotd*);
+
+int optbotd_connect(const char*);
+bool parse_command_line_remote_fd(struct cli_arg_list*, int, int,
+  const char**);
+bool parse_command_line_remote(struct cli_arg_list*, const char*, int,
+  const char**);
+
+#endif
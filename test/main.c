@@ -1,7 +1,12 @@
 #include <check.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
 #include "../src/liboptbot.h"
+#include "../src/optbotd.h"
+#include "../build/test_spec.h"
 
 START_TEST(test_little_opt) {
   const char* args[] = {"-v"};
@@ -204,6 +209,723 @@ START_TEST(devour_flag_not_set) {
 }
 END_TEST
 
+START_TEST(command_buffer) {
+  const char buf[] = "prog\0-vffile.txt\0--record\0one\0two\0-r\0three";
+  struct cli_arg_list* arg_list = init_cli_arg_list();
+  struct cli_arg* arg;
+
+  add_arg(arg_list, 'v', "verbose", "...", false);
+  add_arg(arg_list, 'f', "file", "...", true);
+  add_arg(arg_list, 'r', "record", "...", true);
+
+  fail_unless(parse_command_buffer(arg_list, buf, sizeof(buf)),
+    "Could not parse command buffer");
+
+  fail_unless(little_opt_arg(arg_list, 'v')->times_set == 1);
+  fail_unless(strcmp(little_opt_arg(arg_list, 'f')->values[0],
+    "file.txt") == 0);
+
+  arg = little_opt_arg(arg_list, 'r');
+  fail_unless(arg->values_length == 2,
+    "arg->values_length is incorrect: expected 2, got %d", arg->values_length);
+  fail_unless(strcmp(arg->values[0], "one") == 0);
+  fail_unless(strcmp(arg->values[1], "three") == 0);
+
+  fail_unless(arg_list->argc == 2, "argc is %d, expected 2", arg_list->argc);
+  fail_unless(strcmp(arg_list->argv[0], "prog") == 0);
+  fail_unless(strcmp(arg_list->argv[1], "two") == 0);
+  destroy_cli_arg_list(arg_list);
+}
+END_TEST
+
+START_TEST(unterminated_command_buffer) {
+  const char buf[] = {'-', 'v', '\0', 'x'};
+  struct cli_arg_list* arg_list = init_cli_arg_list();
+
+  add_arg(arg_list, 'v', "verbose", "...", false);
+  fail_if(parse_command_buffer(arg_list, buf, sizeof(buf)),
+    "Parsed an unterminated buffer");
+  fail_unless(arg_list->error == bad_buffer,
+    "Arg list error was not set properly");
+  destroy_cli_arg_list(arg_list);
+}
+END_TEST
+
+START_TEST(list_reuse) {
+  const char first[] = "-v\0-ffirst\0leftover";
+  const char second[] = "--file\0second";
+  struct cli_arg_list* arg_list = init_cli_arg_list();
+  struct cli_arg* arg;
+
+  add_arg(arg_list, 'v', "verbose", "...", false);
+  add_arg(arg_list, 'f', "file", "...", true);
+
+  fail_unless(parse_command_buffer(arg_list, first, sizeof(first)));
+  reset_cli_arg_list(arg_list);
+  fail_unless(parse_command_buffer(arg_list, second, sizeof(second)));
+
+  fail_unless(little_opt_arg(arg_list, 'v')->times_set == 0);
+  arg = little_opt_arg(arg_list, 'f');
+  fail_unless(arg->times_set == 1);
+  fail_unless(arg->values_length == 1);
+  fail_unless(strcmp(arg->values[0], "second") == 0);
+  fail_unless(arg_list->argc == 0, "argc is %d, expected 0", arg_list->argc);
+  destroy_cli_arg_list(arg_list);
+}
+END_TEST
+
+START_TEST(required_arg) {
+  const char* args[] = {"-v"};
+  struct cli_arg_list* arg_list = init_cli_arg_list();
+
+  add_arg(arg_list, 'v', "verbose", "...", false);
+  add_arg(arg_list, 'f', "file", "...", true);
+  arg_required(arg_list, big_opt_arg(arg_list, "file"));
+
+  fail_if(parse_command_line(arg_list, 1, args),
+    "Parsed without a required argument");
+  fail_unless(arg_list->error == missing_required,
+    "Arg list error was not set properly");
+  fail_unless(strcmp(arg_list->message, "--file is required!") == 0,
+    "Unexpected message: %s", arg_list->message);
+  destroy_cli_arg_list(arg_list);
+}
+END_TEST
+
+START_TEST(max_times) {
+  const char* args[] = {"-v", "-v", "-f", "one", "-f", "two"};
+  struct cli_arg_list* arg_list = init_cli_arg_list();
+
+  add_arg(arg_list, 'v', "verbose", "...", false);
+  add_arg(arg_list, 'f', "file", "...", true);
+  arg_max_times(big_opt_arg(arg_list, "verbose"), 2);
+
+  fail_unless(parse_command_line(arg_list, 6, args),
+    "Could not parse command line: %s", arg_list->message);
+
+  reset_cli_arg_list(arg_list);
+  little_opt_arg(arg_list, 'f')->allow_multiple = false;
+  fail_if(parse_command_line(arg_list, 6, args),
+    "Parsed an argument given more times than allowed");
+  fail_unless(arg_list->error == set_twice,
+    "Arg list error was not set properly");
+  destroy_cli_arg_list(arg_list);
+}
+END_TEST
+
+START_TEST(conflicting_args) {
+  const char* args[] = {"-q", "--verbose"};
+  struct cli_arg_list* arg_list = init_cli_arg_list();
+
+  add_arg(arg_list, 'v', "verbose", "...", false);
+  add_arg(arg_list, 'q', "quiet", "...", false);
+  arg_conflicts(arg_list, little_opt_arg(arg_list, 'v'),
+    little_opt_arg(arg_list, 'q'));
+
+  fail_unless(parse_command_line(arg_list, 1, args),
+    "Could not parse command line: %s", arg_list->message);
+
+  reset_cli_arg_list(arg_list);
+  fail_if(parse_command_line(arg_list, 2, args),
+    "Parsed conflicting arguments");
+  fail_unless(arg_list->error == conflicting_opts,
+    "Arg list error was not set properly");
+  destroy_cli_arg_list(arg_list);
+}
+END_TEST
+
+START_TEST(dependent_args) {
+  const char* args[] = {"--output", "out.txt", "--format", "json"};
+  char big[8];
+  int i;
+  struct cli_arg_list* arg_list = init_cli_arg_list();
+
+  /* Spread the arguments over more than one bitset word */
+  for(i = 0; i < 100; i++) {
+    sprintf(big, "opt%d", i);
+    add_arg(arg_list, '\0', big, "...", false);
+  }
+  add_arg(arg_list, 'o', "output", "...", true);
+  add_arg(arg_list, 'F', "format", "...", true);
+  arg_requires(arg_list, big_opt_arg(arg_list, "format"),
+    big_opt_arg(arg_list, "output"));
+
+  fail_unless(parse_command_line(arg_list, 4, args),
+    "Could not parse command line: %s", arg_list->message);
+
+  reset_cli_arg_list(arg_list);
+  fail_if(parse_command_line(arg_list, 2, args + 2),
+    "Parsed without a dependency");
+  fail_unless(arg_list->error == missing_dependency,
+    "Arg list error was not set properly");
+  fail_unless(strcmp(arg_list->message, "--format requires --output!") == 0,
+    "Unexpected message: %s", arg_list->message);
+  destroy_cli_arg_list(arg_list);
+}
+END_TEST
+
+START_TEST(arg_handles) {
+  const char* args[] = {"-v", "-rone", "--verbose", "--record", "two"};
+  struct cli_arg_list* arg_list = init_cli_arg_list();
+  int verbose, record, quiet;
+
+  verbose = add_arg(arg_list, 'v', "verbose", "...", false)->index;
+  record = add_arg(arg_list, 'r', "record", "...", true)->index;
+  quiet = add_arg(arg_list, 'q', "quiet", "...", false)->index;
+
+  fail_unless(parse_command_line(arg_list, 5, args),
+    "Could not parse command line: %s", arg_list->message);
+
+  fail_unless(optbot_arg(arg_list, verbose) == little_opt_arg(arg_list, 'v'));
+  fail_unless(optbot_count(arg_list, verbose) == 2);
+  fail_unless(optbot_count(arg_list, quiet) == 0);
+  fail_unless(optbot_values_length(arg_list, record) == 2);
+  fail_unless(strcmp(optbot_value(arg_list, record, 0), "one") == 0);
+  fail_unless(strcmp(optbot_value(arg_list, record, 1), "two") == 0);
+  fail_unless(optbot_value(arg_list, record, 2) == NULL);
+  destroy_cli_arg_list(arg_list);
+}
+END_TEST
+
+static bool validate_number(const char* value, void** result, void* data) {
+  char* end;
+  long* number;
+
+  atomic_fetch_add((atomic_int*)data, 1);
+  if(strcmp(value, "bad") == 0) return false;
+
+  number = malloc(sizeof(long));
+  *number = strtol(value, &end, 10);
+  *result = number;
+  return true;
+}
+
+START_TEST(value_validation) {
+  const char* args[] = {"-n", "1", "--number", "2", "-n3"};
+  struct cli_arg_list* arg_list = init_cli_arg_list();
+  atomic_int calls;
+  int number;
+
+  atomic_init(&calls, 0);
+  number = add_arg(arg_list, 'n', "number", "...", true)->index;
+  add_arg(arg_list, 'v', "verbose", "...", false);
+  arg_validator(optbot_arg(arg_list, number), validate_number, free, &calls);
+
+  fail_unless(parse_command_line(arg_list, 5, args),
+    "Could not parse command line: %s", arg_list->message);
+  fail_unless(validate_cli_arg_list(arg_list, 1),
+    "Could not validate: %s", arg_list->message);
+
+  fail_unless(calls == 3, "Validator called %d times, expected 3", calls);
+  fail_unless(*(long*)optbot_result(arg_list, number, 0) == 1);
+  fail_unless(*(long*)optbot_result(arg_list, number, 2) == 3);
+  destroy_cli_arg_list(arg_list);
+}
+END_TEST
+
+START_TEST(parallel_value_validation) {
+  char* args[400];
+  struct cli_arg_list* arg_list = init_cli_arg_list();
+  atomic_int calls;
+  int number, other;
+  int i;
+
+  atomic_init(&calls, 0);
+  number = add_arg(arg_list, 'n', "number", "...", true)->index;
+  other = add_arg(arg_list, 'o', "other", "...", true)->index;
+  arg_validator(optbot_arg(arg_list, number), validate_number, free, &calls);
+  arg_validator(optbot_arg(arg_list, other), validate_number, free, &calls);
+
+  for(i = 0; i < 400; i++) {
+    args[i] = malloc(16);
+    sprintf(args[i], "-%c%d", i % 3 ? 'n' : 'o', i);
+  }
+  /* The later bad value belongs to the argument validated first */
+  strcpy(args[301], "-nbad");
+  strcpy(args[150], "-obad");
+
+  fail_unless(parse_command_line(arg_list, 400, (const char**)args),
+    "Could not parse command line: %s", arg_list->message);
+  fail_if(validate_cli_arg_list(arg_list, 4), "Validated a bad value");
+  fail_unless(arg_list->error == invalid_value,
+    "Arg list error was not set properly");
+  fail_unless(strcmp(arg_list->message,
+    "--other was given an invalid value: bad") == 0,
+    "Unexpected message: %s", arg_list->message);
+  fail_unless(calls == 400, "Validator called %d times", calls);
+  fail_unless(arg_list->invalid_length == 2,
+    "%d invalid values listed", arg_list->invalid_length);
+  fail_unless(arg_list->invalid[0].handle == other &&
+    arg_list->invalid[0].position == 150);
+  fail_unless(arg_list->invalid[1].handle == number &&
+    arg_list->invalid[1].position == 301);
+  fail_unless(strcmp(optbot_value(arg_list, arg_list->invalid[1].handle,
+    arg_list->invalid[1].value), "bad") == 0);
+  fail_unless(*(long*)optbot_result(arg_list, number, 0) == 1);
+
+  for(i = 0; i < 400; i++) free(args[i]);
+  destroy_cli_arg_list(arg_list);
+}
+END_TEST
+
+START_TEST(spec_list) {
+  const char* args[] = {"-vvffile.txt", "--long-only", "--record", "one",
+    "-xtwo", "leftover"};
+  struct cli_arg_list* arg_list = init_cli_arg_list_spec(&test_spec);
+
+  fail_unless(parse_command_line(arg_list, 6, args),
+    "Could not parse command line: %s", arg_list->message);
+
+  fail_unless(optbot_count(arg_list, TEST_VERBOSE) == 2);
+  fail_unless(optbot_count(arg_list, TEST_QUIET) == 0);
+  fail_unless(optbot_count(arg_list, TEST_LONG_ONLY) == 1);
+  fail_unless(strcmp(optbot_value(arg_list, TEST_FILE, 0), "file.txt") == 0);
+  fail_unless(strcmp(optbot_value(arg_list, TEST_RECORD, 0), "one") == 0);
+  fail_unless(strcmp(optbot_value(arg_list, TEST_x, 0), "two") == 0);
+  fail_unless(big_opt_arg(arg_list, "record") ==
+    optbot_arg(arg_list, TEST_RECORD));
+  fail_unless(big_opt_arg(arg_list, "nope") == NULL);
+  fail_unless(little_opt_arg(arg_list, 'z') == NULL);
+  fail_unless(arg_list->argc == 1, "argc is %d, expected 1", arg_list->argc);
+  destroy_cli_arg_list(arg_list);
+}
+END_TEST
+
+START_TEST(spec_list_limits) {
+  const char* args[] = {"-f", "one", "--file", "two"};
+  struct cli_arg_list* arg_list = init_cli_arg_list_spec(&test_spec);
+
+  fail_if(parse_command_line(arg_list, 4, args),
+    "Parsed an argument given more times than its spec allows");
+  fail_unless(arg_list->error == set_twice,
+    "Arg list error was not set properly");
+  destroy_cli_arg_list(arg_list);
+}
+END_TEST
+
+START_TEST(spec_list_with_added_arg) {
+  const char* args[] = {"-v", "--extra", "-e"};
+  struct cli_arg_list* arg_list = init_cli_arg_list_spec(&test_spec);
+  int extra;
+
+  extra = add_arg(arg_list, 'e', "extra", "...", false)->index;
+  fail_unless(parse_command_line(arg_list, 3, args),
+    "Could not parse command line: %s", arg_list->message);
+  fail_unless(optbot_count(arg_list, extra) == 2);
+  fail_unless(optbot_count(arg_list, TEST_VERBOSE) == 1);
+  destroy_cli_arg_list(arg_list);
+}
+END_TEST
+
+static int find_nothing_little(char little) {
+  return -1;
+}
+
+static int find_nothing_big(const char* big) {
+  return -1;
+}
+
+START_TEST(empty_spec_list_with_added_arg) {
+  const struct optbot_spec empty = {"empty", 0, NULL, find_nothing_little,
+    find_nothing_big};
+  const char* args[] = {"-e"};
+  struct cli_arg_list* arg_list = init_cli_arg_list_spec(&empty);
+  struct cli_arg* extra;
+
+  fail_unless(arg_list != NULL, "Could not create a list from a spec");
+  extra = add_arg(arg_list, 'e', "extra", "...", false);
+  fail_unless(extra != NULL, "Could not add an argument");
+  fail_unless(parse_command_line(arg_list, 1, args),
+    "Could not parse command line: %s", arg_list->message);
+  fail_unless(optbot_count(arg_list, extra->index) == 1);
+  destroy_cli_arg_list(arg_list);
+}
+END_TEST
+
+START_TEST(packed_result) {
+  const char* args[] = {"-vvffile.txt", "--record", "one", "leftover",
+    "-xtwo"};
+  struct cli_arg_list* parsed = init_cli_arg_list_spec(&test_spec);
+  struct cli_arg_list* unpacked = init_cli_arg_list_spec(&test_spec);
+  char buf[512];
+  size_t len;
+
+  fail_unless(parse_command_line(parsed, 5, args),
+    "Could not parse command line: %s", parsed->message);
+  len = pack_cli_arg_list(parsed, buf, sizeof(buf));
+  fail_unless(len <= sizeof(buf), "Packed result is %zu bytes", len);
+  fail_unless(pack_cli_arg_list(parsed, buf, 4) == len,
+    "Packing into a short buffer gave a different length");
+
+  fail_unless(unpack_cli_arg_list(unpacked, 5, args, buf, len),
+    "Could not unpack: %s", unpacked->message);
+  fail_unless(optbot_count(unpacked, TEST_VERBOSE) == 2);
+  fail_unless(strcmp(optbot_value(unpacked, TEST_FILE, 0), "file.txt") == 0);
+  fail_unless(strcmp(optbot_value(unpacked, TEST_RECORD, 0), "one") == 0);
+  fail_unless(strcmp(optbot_value(unpacked, TEST_x, 0), "two") == 0);
+  fail_unless(unpacked->argc == 1 &&
+    strcmp(unpacked->argv[0], "leftover") == 0);
+
+  reset_cli_arg_list(unpacked);
+  fail_if(unpack_cli_arg_list(unpacked, 5, args, buf, len - 1),
+    "Unpacked a truncated result");
+  fail_unless(unpacked->error == remote_failed,
+    "Arg list error was not set properly");
+
+  destroy_cli_arg_list(parsed);
+  destroy_cli_arg_list(unpacked);
+}
+END_TEST
+
+START_TEST(remote_parse) {
+  const struct optbot_spec* specs[] = {&test_spec};
+  const char* args[] = {"-vv", "--file", "out.txt", "--", "-q"};
+  const char* bad_args[] = {"-f", "one", "-f", "two"};
+  char path[64];
+  struct optbotd* server;
+  struct cli_arg_list* arg_list = init_cli_arg_list_spec(&test_spec);
+  int fd;
+
+  snprintf(path, sizeof(path), "/tmp/optbot-test-%d.sock", (int)getpid());
+  server = optbotd_start(path, specs, 1, 2);
+  fail_unless(server != NULL, "Could not start optbotd");
+
+  arg_list->devour_flag = true;
+  fail_unless(parse_command_line_remote(arg_list, path, 5, args),
+    "Could not parse command line: %s", arg_list->message);
+  fail_unless(optbot_count(arg_list, TEST_VERBOSE) == 2);
+  fail_unless(optbot_count(arg_list, TEST_QUIET) == 0);
+  fail_unless(strcmp(optbot_value(arg_list, TEST_FILE, 0), "out.txt") == 0);
+  fail_unless(arg_list->argc == 1 && strcmp(arg_list->argv[0], "-q") == 0);
+
+  fd = optbotd_connect(path);
+  fail_unless(fd >= 0, "Could not connect to optbotd");
+  reset_cli_arg_list(arg_list);
+  fail_if(parse_command_line_remote_fd(arg_list, fd, 4, bad_args),
+    "Parsed an argument given more times than its spec allows");
+  fail_unless(arg_list->error == set_twice,
+    "Arg list error was not set properly");
+  reset_cli_arg_list(arg_list);
+  fail_unless(parse_command_line_remote_fd(arg_list, fd, 2, bad_args),
+    "Could not parse command line: %s", arg_list->message);
+  fail_unless(strcmp(optbot_value(arg_list, TEST_FILE, 0), "one") == 0);
+  close(fd);
+
+  optbotd_stop(server);
+  reset_cli_arg_list(arg_list);
+  fail_if(parse_command_line_remote(arg_list, path, 5, args),
+    "Parsed with a stopped optbotd");
+  fail_unless(arg_list->error == remote_failed,
+    "Arg list error was not set properly");
+  destroy_cli_arg_list(arg_list);
+}
+END_TEST
+
+START_TEST(reparse) {
+  const char* args[] = {"-vffile.txt", "--record", "one", "-rtwo", "left"};
+  const char* new_args[] = {"--record", "one", "-rtwo", "-ffile.txt",
+    "-q", "left"};
+  const char* bad_args[] = {"-f", "one", "-f", "two"};
+  struct cli_arg_list* arg_list = init_cli_arg_list_spec(&test_spec);
+  const char* file;
+  const char* record;
+
+  fail_unless(reparse_command_line(arg_list, 5, args),
+    "Could not parse command line: %s", arg_list->message);
+  fail_unless(optbot_changed(arg_list, TEST_VERBOSE));
+  fail_unless(optbot_changed(arg_list, TEST_FILE));
+  fail_unless(! optbot_changed(arg_list, TEST_QUIET));
+  fail_unless(arg_list->argv_changed);
+  file = optbot_value(arg_list, TEST_FILE, 0);
+  record = optbot_value(arg_list, TEST_RECORD, 1);
+
+  fail_unless(reparse_command_line(arg_list, 6, new_args),
+    "Could not parse command line: %s", arg_list->message);
+  fail_unless(optbot_changed(arg_list, TEST_VERBOSE));
+  fail_unless(optbot_changed(arg_list, TEST_QUIET));
+  fail_unless(! optbot_changed(arg_list, TEST_FILE));
+  fail_unless(! optbot_changed(arg_list, TEST_RECORD));
+  fail_unless(! arg_list->argv_changed);
+  fail_unless(optbot_count(arg_list, TEST_VERBOSE) == 0);
+  fail_unless(optbot_count(arg_list, TEST_QUIET) == 1);
+  fail_unless(optbot_value(arg_list, TEST_FILE, 0) == file,
+    "An unchanged value was replaced");
+  fail_unless(optbot_value(arg_list, TEST_RECORD, 1) == record,
+    "An unchanged value was replaced");
+  fail_unless(optbot_arg(arg_list, TEST_FILE)->positions[0] == 3);
+
+  fail_if(reparse_command_line(arg_list, 4, bad_args),
+    "Parsed an argument given more times than its spec allows");
+  fail_unless(arg_list->error == set_twice,
+    "Arg list error was not set properly");
+  fail_unless(! optbot_changed(arg_list, TEST_FILE));
+  fail_unless(optbot_count(arg_list, TEST_QUIET) == 1);
+  fail_unless(optbot_value(arg_list, TEST_FILE, 0) == file,
+    "A failed re-parse replaced a value");
+  fail_unless(arg_list->argc == 1 && strcmp(arg_list->argv[0], "left") == 0);
+
+  destroy_cli_arg_list(arg_list);
+}
+END_TEST
+
+START_TEST(reparse_clears_invalid) {
+  const char* bad_args[] = {"-fbad"};
+  const char* good_args[] = {"-fok"};
+  struct cli_arg_list* arg_list = init_cli_arg_list_spec(&test_spec);
+  atomic_int calls;
+
+  atomic_init(&calls, 0);
+  arg_validator(optbot_arg(arg_list, TEST_FILE), validate_number, free,
+    &calls);
+  fail_unless(reparse_command_line(arg_list, 1, bad_args),
+    "Could not parse command line: %s", arg_list->message);
+  fail_if(validate_cli_arg_list(arg_list, 1), "Validated a bad value");
+  fail_unless(arg_list->invalid_length == 1);
+
+  fail_unless(reparse_command_line(arg_list, 1, good_args),
+    "Could not parse command line: %s", arg_list->message);
+  fail_unless(arg_list->invalid_length == 0 && arg_list->invalid == NULL,
+    "A re-parse kept the invalid values of the old parse");
+  fail_unless(validate_cli_arg_list(arg_list, 1),
+    "Could not validate: %s", arg_list->message);
+
+  destroy_cli_arg_list(arg_list);
+}
+END_TEST
+
+START_TEST(packed_values) {
+  char args[1000][16];
+  const char* argv[1000];
+  const char* changed_argv[] = {"-v", "-rone", "--record", "two"};
+  struct cli_arg_list* arg_list = init_cli_arg_list_spec(&test_spec);
+  struct cli_arg* arg = optbot_arg(arg_list, TEST_RECORD);
+  int i;
+
+  for(i = 0; i < 1000; i++) {
+    sprintf(args[i], "-rvalue%d", i);
+    argv[i] = args[i];
+  }
+
+  fail_unless(arg_packed(arg), "Could not pack an argument");
+  fail_unless(parse_command_line(arg_list, 1000, argv),
+    "Could not parse command line: %s", arg_list->message);
+  fail_unless(arg->values == NULL, "A packed argument used values");
+  fail_unless(optbot_values_length(arg_list, TEST_RECORD) == 1000);
+  for(i = 0; i < 1000; i++) {
+    fail_unless(strcmp(optbot_value(arg_list, TEST_RECORD, i), args[i] + 2)
+      == 0, "Arg values do not match: %d: %s != %s", i,
+      optbot_value(arg_list, TEST_RECORD, i), args[i] + 2);
+  }
+  fail_unless(cli_arg_value(arg, 1000) == NULL);
+
+  fail_unless(reparse_command_line(arg_list, 4, changed_argv),
+    "Could not parse command line: %s", arg_list->message);
+  fail_unless(optbot_changed(arg_list, TEST_RECORD));
+  fail_unless(optbot_values_length(arg_list, TEST_RECORD) == 2);
+  fail_unless(strcmp(cli_arg_value(arg, 0), "one") == 0);
+  fail_unless(strcmp(cli_arg_value(arg, 1), "two") == 0);
+  fail_unless(reparse_command_line(arg_list, 4, changed_argv),
+    "Could not parse command line: %s", arg_list->message);
+  fail_unless(! optbot_changed(arg_list, TEST_RECORD));
+
+  reset_cli_arg_list(arg_list);
+  fail_unless(parse_command_line(arg_list, 1, argv),
+    "Could not parse command line: %s", arg_list->message);
+  fail_unless(strcmp(cli_arg_value(arg, 0), "value0") == 0);
+  destroy_cli_arg_list(arg_list);
+
+  /* Packing an argument that has held values needs it reset first */
+  arg_list = init_cli_arg_list_spec(&test_spec);
+  arg = optbot_arg(arg_list, TEST_RECORD);
+  fail_unless(parse_command_line(arg_list, 4, changed_argv),
+    "Could not parse command line: %s", arg_list->message);
+  fail_if(arg_packed(arg), "Packed an argument holding values");
+  fail_unless(! arg->packed);
+  fail_unless(strcmp(cli_arg_value(arg, 1), "two") == 0);
+  reset_cli_arg_list(arg_list);
+  fail_unless(arg_packed(arg), "Could not pack an argument");
+  fail_unless(parse_command_line(arg_list, 1000, argv),
+    "Could not parse command line: %s", arg_list->message);
+  fail_unless(optbot_values_length(arg_list, TEST_RECORD) == 1000);
+  fail_unless(strcmp(cli_arg_value(arg, 999), "value999") == 0);
+  destroy_cli_arg_list(arg_list);
+}
+END_TEST
+
+START_TEST(overlay) {
+  const char* base_args[] = {"-vv", "--file", "base.txt", "-rone", "left"};
+  const char* job_args[] = {"--file", "job.txt", "-q", "job"};
+  const char* bad_args[] = {"-qq"};
+  struct cli_arg_list* base = init_cli_arg_list_spec(&test_spec);
+  struct cli_arg_list* job;
+
+  fail_unless(parse_command_line(base, 5, base_args),
+    "Could not parse command line: %s", base->message);
+  job = init_cli_arg_list_overlay(base);
+  fail_unless(job != NULL, "Could not create an overlay");
+
+  fail_unless(optbot_count(job, TEST_VERBOSE) == 2);
+  fail_unless(parse_command_line(job, 4, job_args),
+    "Could not parse command line: %s", job->message);
+  fail_unless(strcmp(optbot_value(job, TEST_FILE, 0), "job.txt") == 0);
+  fail_unless(optbot_values_length(job, TEST_FILE) == 1);
+  fail_unless(optbot_count(job, TEST_QUIET) == 1);
+  fail_unless(optbot_count(job, TEST_VERBOSE) == 2);
+  fail_unless(strcmp(optbot_value(job, TEST_RECORD, 0), "one") == 0);
+  fail_unless(big_opt_arg(job, "record") == optbot_arg(base, TEST_RECORD));
+  fail_unless(little_opt_arg(job, 'f') == optbot_arg(job, TEST_FILE));
+  fail_unless(job->argc == 1 && strcmp(job->argv[0], "job") == 0);
+
+  fail_unless(strcmp(optbot_value(base, TEST_FILE, 0), "base.txt") == 0);
+  fail_unless(optbot_count(base, TEST_QUIET) == 0);
+
+  reset_cli_arg_list(job);
+  fail_unless(strcmp(optbot_value(job, TEST_FILE, 0), "base.txt") == 0);
+  fail_if(parse_command_line(job, 1, bad_args),
+    "Parsed an argument given more times than its spec allows");
+  fail_unless(job->error == set_twice,
+    "Arg list error was not set properly");
+
+  destroy_cli_arg_list(job);
+  fail_unless(optbot_count(base, TEST_QUIET) == 0);
+  destroy_cli_arg_list(base);
+}
+END_TEST
+
+START_TEST(overlay_read_only_base) {
+  const char* base_args[] = {"-v", "--file", "base.txt"};
+  const char* job_args[] = {"-q"};
+  struct cli_arg_list* base = init_cli_arg_list_spec(&test_spec);
+  struct cli_arg_list* job;
+  struct cli_arg_list* unpacked;
+  struct cli_arg* quiet;
+  struct cli_arg* file;
+  char buf[256];
+  size_t len;
+  int arg_count;
+
+  fail_unless(parse_command_line(base, 3, base_args),
+    "Could not parse command line: %s", base->message);
+  arg_count = base->arg_count;
+  job = init_cli_arg_list_overlay(base);
+  fail_unless(job != NULL, "Could not create an overlay");
+  quiet = optbot_arg(job, TEST_QUIET);
+  file = optbot_arg(job, TEST_FILE);
+
+  fail_unless(add_arg(job, 'n', "new", "...", false) == NULL,
+    "Added an argument to an overlay");
+  fail_unless(job->error == overlay_read_only,
+    "Arg list error was not set properly");
+  fail_unless(base->arg_count == arg_count);
+  fail_if(arg_required(job, quiet), "Required an argument of an overlay");
+  fail_if(arg_conflicts(job, quiet, file),
+    "Added a conflict to an overlay");
+  fail_if(arg_requires(job, quiet, file),
+    "Added a dependency to an overlay");
+  fail_unless(! quiet->required && quiet->conflicts == NULL &&
+    quiet->requires == NULL, "An overlay changed its base's arguments");
+  fail_if(reparse_command_line(job, 1, job_args), "Re-parsed an overlay");
+  fail_unless(job->error == overlay_read_only,
+    "Arg list error was not set properly");
+  fail_unless(optbot_count(base, TEST_QUIET) == 0);
+
+  fail_unless(parse_command_line(job, 1, job_args),
+    "Could not parse command line: %s", job->message);
+  fail_unless(optbot_count(job, TEST_QUIET) == 1);
+  fail_unless(optbot_count(base, TEST_QUIET) == 0);
+
+  fail_unless(init_cli_arg_list_overlay(job) == NULL,
+    "Made an overlay of an overlay");
+  len = pack_cli_arg_list(job, buf, sizeof(buf));
+  fail_unless(len <= sizeof(buf));
+  unpacked = init_cli_arg_list_spec(&test_spec);
+  fail_if(unpack_cli_arg_list(unpacked, 1, job_args, buf, len),
+    "Unpacked an overlay");
+  fail_unless(unpacked->error == overlay_read_only,
+    "Arg list error was not set properly");
+  fail_unless(optbot_count(unpacked, TEST_VERBOSE) == 0);
+
+  destroy_cli_arg_list(unpacked);
+  destroy_cli_arg_list(job);
+  destroy_cli_arg_list(base);
+}
+END_TEST
+
+/* Parses overlays of a shared base, counting any that come out wrong */
+static void* parse_overlays(void* base_ptr) {
+  const struct cli_arg_list* base = base_ptr;
+  struct cli_arg_list* job;
+  char value[16];
+  const char* args[] = {"-f", value};
+  int wrong = 0;
+  int i;
+
+  for(i = 0; i < 1000; i++) {
+    sprintf(value, "%d", i);
+    job = init_cli_arg_list_overlay(base);
+    if(! job || ! parse_command_line(job, 2, args) ||
+      strcmp(optbot_value(job, TEST_FILE, 0), value) != 0 ||
+      optbot_count(job, TEST_VERBOSE) != 1) wrong++;
+    if(job) destroy_cli_arg_list(job);
+  }
+
+  return (void*)(long)wrong;
+}
+
+START_TEST(shared_overlay_base) {
+  const char* base_args[] = {"-v", "--file", "base.txt"};
+  struct cli_arg_list* base = init_cli_arg_list_spec(&test_spec);
+  pthread_t threads[4];
+  void* wrong;
+  int i;
+
+  fail_unless(parse_command_line(base, 3, base_args),
+    "Could not parse command line: %s", base->message);
+  for(i = 0; i < 4; i++)
+    pthread_create(&threads[i], NULL, parse_overlays, base);
+  for(i = 0; i < 4; i++) {
+    pthread_join(threads[i], &wrong);
+    fail_unless(wrong == NULL, "%ld overlays were wrong", (long)wrong);
+  }
+  fail_unless(strcmp(optbot_value(base, TEST_FILE, 0), "base.txt") == 0);
+  destroy_cli_arg_list(base);
+}
+END_TEST
+
+START_TEST(remote_idle_connections) {
+  const struct optbot_spec* specs[] = {&test_spec};
+  const char* args[] = {"-v"};
+  char path[64];
+  struct optbotd* server;
+  struct cli_arg_list* arg_list = init_cli_arg_list_spec(&test_spec);
+  int idle[2];
+  int fd;
+
+  snprintf(path, sizeof(path), "/tmp/optbot-idle-%d.sock", (int)getpid());
+  server = optbotd_start(path, specs, 1, 2);
+  fail_unless(server != NULL, "Could not start optbotd");
+
+  /* One connection never sends anything, the other stops partway through
+     a request, and neither may hold up the next client or the stop */
+  idle[0] = optbotd_connect(path);
+  idle[1] = optbotd_connect(path);
+  fail_unless(idle[0] >= 0 && idle[1] >= 0, "Could not connect to optbotd");
+  fail_unless(write(idle[1], "\x10\0", 2) == 2);
+
+  fd = optbotd_connect(path);
+  fail_unless(fd >= 0, "Could not connect to optbotd");
+  fail_unless(parse_command_line_remote_fd(arg_list, fd, 1, args),
+    "Could not parse command line: %s", arg_list->message);
+  fail_unless(optbot_count(arg_list, TEST_VERBOSE) == 1);
+
+  optbotd_stop(server);
+  close(fd);
+  close(idle[0]);
+  close(idle[1]);
+  destroy_cli_arg_list(arg_list);
+}
+END_TEST
+
 Suite* optbot_suite(void) {
   Suite *suite = suite_create("liboptbot");
 
@@ -218,6 +940,29 @@ Suite* optbot_suite(void) {
   tcase_add_test(main_case, leftover_argv);
   tcase_add_test(main_case, devour_flag);
   tcase_add_test(main_case, devour_flag_not_set);
+  tcase_add_test(main_case, command_buffer);
+  tcase_add_test(main_case, unterminated_command_buffer);
+  tcase_add_test(main_case, list_reuse);
+  tcase_add_test(main_case, required_arg);
+  tcase_add_test(main_case, max_times);
+  tcase_add_test(main_case, conflicting_args);
+  tcase_add_test(main_case, dependent_args);
+  tcase_add_test(main_case, arg_handles);
+  tcase_add_test(main_case, value_validation);
+  tcase_add_test(main_case, parallel_value_validation);
+  tcase_add_test(main_case, spec_list);
+  tcase_add_test(main_case, spec_list_limits);
+  tcase_add_test(main_case, spec_list_with_added_arg);
+  tcase_add_test(main_case, empty_spec_list_with_added_arg);
+  tcase_add_test(main_case, packed_result);
+  tcase_add_test(main_case, remote_parse);
+  tcase_add_test(main_case, remote_idle_connections);
+  tcase_add_test(main_case, reparse);
+  tcase_add_test(main_case, reparse_clears_invalid);
+  tcase_add_test(main_case, packed_values);
+  tcase_add_test(main_case, overlay);
+  tcase_add_test(main_case, overlay_read_only_base);
+  tcase_add_test(main_case, shared_overlay_base);
   suite_add_tcase(suite, main_case);
   return suite;
 }
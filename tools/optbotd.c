@@ -0,0 +1,45 @@
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "optbotd.h"
+#include "optbotd_spec.h"
+
+/* The optbotd daemon serves the spec compiled into build/optbotd_spec.c,
+ * which the Makefile generates from OPTBOTD_OPTS and names OPTBOTD_SPEC.
+ *
+ * Usage: optbotd <socket path> [workers]
+ */
+
+#define SPEC_SYMBOL(name) SPEC_SYMBOL_(name)
+#define SPEC_SYMBOL_(name) name ## _spec
+
+int main(int argc, char** argv) {
+  const struct optbot_spec* specs[] = {&SPEC_SYMBOL(OPTBOTD_SPEC)};
+  struct optbotd* server;
+  sigset_t signals;
+  int workers = argc > 2 ? atoi(argv[2]) : 4;
+  int signal;
+
+  if(argc < 2 || workers < 1) {
+    fprintf(stderr, "Usage: %s <socket path> [workers]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  /* Blocked before the workers start so that only sigwait sees them */
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+  server = optbotd_start(argv[1], specs, 1, workers);
+  if(! server) {
+    fprintf(stderr, "%s: couldn't listen on %s\n", argv[0], argv[1]);
+    return EXIT_FAILURE;
+  }
+
+  sigwait(&signals, &signal);
+  optbotd_stop(server);
+
+  return EXIT_SUCCESS;
+}
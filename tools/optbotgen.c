@@ -0,0 +1,528 @@
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* optbotgen compiles an option definition file into a C source and header
+ * holding a static struct optbot_spec for liboptbot.  Long options are
+ * looked up through a minimal perfect hash and short options through a
+ * switch, so a list made with init_cli_arg_list_spec() never searches.
+ *
+ * Usage: optbotgen <definition file> <spec name> <output prefix>
+ *
+ * Each line of the definition file describes one option:
+ *
+ *   <little> <big> <value|flag> <multiplicity> <description>
+ *
+ * little and big may be - if the option doesn't have one.  multiplicity is
+ * the most times the option may be given, or * for no limit.  Blank lines
+ * and lines starting with # are ignored.  A file must define at least one
+ * option.
+ *
+ * Each option gets a handle constant named after its big option, upper
+ * cased with anything but letters and digits turned into _, or after its
+ * little option, with anything but a letter or digit written as _ and its
+ * hex code.  Options whose handles would have the same name are an error.
+ */
+
+#define LINE_SIZE 1024
+#define MAX_DISPLACEMENT (1u << 24)
+
+/* An option read from the definition file */
+struct gen_arg {
+  char little;
+  char* big;
+  char* description;
+  bool takes_value;
+  int max_times;
+  char* handle; /* The name of its handle, less the spec's name */
+};
+
+/* Everything read from the definition file */
+struct gen_spec {
+  struct gen_arg* args;
+  int args_length;
+  int args_size;
+};
+
+/*! Hashes a long option
+ *
+ *  @note This must match the hash written out by write_source
+ *  @param [key] The option to hash
+ *  @param [seed] Selects a member of the hash family
+ *  @return The hash of key
+ */
+static unsigned int hash(const char* key, unsigned int seed) {
+  unsigned int hash = 2166136261u ^ (seed * 16777619u);
+
+  while(*key) {
+    hash ^= (unsigned char)*key++;
+    hash *= 16777619u;
+  }
+  hash ^= hash >> 15;
+  hash *= 0x2c1b3c6du;
+  hash ^= hash >> 12;
+
+  return hash;
+}
+
+/*! Duplicates a string, exiting if memory runs out
+ *
+ *  @param [str] The string to duplicate
+ *  @return The copy
+ */
+static char* xstrdup(const char* str) {
+  char* copy = strdup(str);
+  if(! copy) {
+    fprintf(stderr, "optbotgen: out of memory\n");
+    exit(EXIT_FAILURE);
+  }
+  return copy;
+}
+
+/*! Makes the name of the handle constant for an option, less the spec's
+ *  name
+ *
+ *  @param [arg] The option to name
+ *  @return The name, which is always a valid part of an identifier
+ */
+static char* handle_name(const struct gen_arg* arg) {
+  char little[4];
+  char* handle;
+  char* c;
+
+  if(arg->big) {
+    handle = xstrdup(arg->big);
+    for(c = handle; *c; c++)
+      *c = isalnum((unsigned char)*c) ? toupper((unsigned char)*c) : '_';
+    return handle;
+  }
+
+  if(isalnum((unsigned char)arg->little))
+    sprintf(little, "%c", arg->little);
+  else
+    sprintf(little, "_%02X", (unsigned char)arg->little);
+  return xstrdup(little);
+}
+
+/*! Reads an option definition file
+ *
+ *  @param [path] The path of the file to read
+ *  @param [out] [spec] The spec to add the options to
+ *  @return True if every line was read, false otherwise
+ */
+static bool read_spec(const char* path, struct gen_spec* spec) {
+  char line[LINE_SIZE];
+  char little[LINE_SIZE], big[LINE_SIZE], kind[LINE_SIZE], times[LINE_SIZE];
+  char* description;
+  char* end;
+  struct gen_arg* arg;
+  int line_number = 0;
+  int consumed;
+  int i;
+  FILE* file = fopen(path, "r");
+
+  if(! file) {
+    fprintf(stderr, "optbotgen: can't open %s\n", path);
+    return false;
+  }
+
+  while(fgets(line, sizeof(line), file)) {
+    line_number++;
+    line[strcspn(line, "\r\n")] = '\0';
+
+    for(description = line; isspace((unsigned char)*description);)
+      description++;
+    if(*description == '\0' || *description == '#') continue;
+
+    if(sscanf(line, "%s %s %s %s %n",
+      little, big, kind, times, &consumed) != 4) goto malformed;
+    description = line + consumed;
+
+    if(spec->args_length == spec->args_size) {
+      spec->args_size += 16;
+      spec->args = realloc(spec->args, sizeof(struct gen_arg) *
+        spec->args_size);
+      if(! spec->args) {
+        fprintf(stderr, "optbotgen: out of memory\n");
+        exit(EXIT_FAILURE);
+      }
+    }
+    arg = &spec->args[spec->args_length];
+
+    if(strlen(little) != 1) goto malformed;
+    arg->little = strcmp(little, "-") == 0 ? '\0' : little[0];
+    arg->big = strcmp(big, "-") == 0 ? NULL : xstrdup(big);
+    arg->description = *description ? xstrdup(description) : NULL;
+
+    if(strcmp(kind, "value") == 0) arg->takes_value = true;
+    else if(strcmp(kind, "flag") == 0) arg->takes_value = false;
+    else goto malformed;
+
+    if(strcmp(times, "*") == 0) {
+      arg->max_times = 0;
+    } else {
+      arg->max_times = strtol(times, &end, 10);
+      if(*end != '\0' || arg->max_times < 1) goto malformed;
+    }
+
+    if(! arg->little && ! arg->big) goto malformed;
+    arg->handle = handle_name(arg);
+
+    for(i = 0; i < spec->args_length; i++) {
+      if((arg->little && spec->args[i].little == arg->little) ||
+        (arg->big && spec->args[i].big && strcmp(spec->args[i].big,
+        arg->big) == 0)) {
+        fprintf(stderr, "%s:%d: option defined twice\n", path, line_number);
+        goto error;
+      }
+      if(strcmp(spec->args[i].handle, arg->handle) == 0) {
+        fprintf(stderr, "%s:%d: handle _%s is already used by another "
+          "option\n", path, line_number, arg->handle);
+        goto error;
+      }
+    }
+
+    spec->args_length++;
+  }
+
+  if(! spec->args_length) {
+    fprintf(stderr, "%s: no options defined\n", path);
+    goto error;
+  }
+
+  fclose(file);
+  return true;
+
+  malformed:
+    fprintf(stderr, "%s:%d: expected <little> <big> <value|flag> "
+      "<multiplicity> <description>\n", path, line_number);
+  error:
+    fclose(file);
+    return false;
+}
+
+/*! Builds a minimal perfect hash over the long options of a spec
+ *
+ *  Keys are split into buckets by hash(key, 0).  Starting with the largest
+ *  bucket, each is given the first seed that places all of its keys in free
+ *  slots, which are then taken.  The slot of a key is
+ *  hash(key, displacements[bucket]) % length.
+ *
+ *  @param [spec] The spec to hash
+ *  @param [keys] The indexes of the options with long options
+ *  @param [length] The number of entries in keys
+ *  @param [out] [displacements] The seed for each bucket
+ *  @param [out] [slots] The option index held by each slot
+ *  @return True if a hash was found, false otherwise
+ */
+static bool build_hash(const struct gen_spec* spec, const int* keys,
+  int length, unsigned int* displacements, int* slots)
+{
+  int* bucket_sizes = calloc(length, sizeof(int));
+  int* order = malloc(sizeof(int) * length);
+  int* placed = malloc(sizeof(int) * length);
+  unsigned int seed;
+  int bucket, biggest, placed_length;
+  int i, j, k, slot;
+  bool fits;
+
+  if(! bucket_sizes || ! order || ! placed) goto error;
+
+  for(i = 0; i < length; i++) {
+    bucket_sizes[hash(spec->args[keys[i]].big, 0) % length]++;
+    slots[i] = -1;
+    displacements[i] = 0;
+    order[i] = i;
+  }
+
+  /* Largest buckets are the hardest to place, so they go first */
+  for(i = 0; i < length; i++) {
+    biggest = i;
+    for(j = i + 1; j < length; j++)
+      if(bucket_sizes[order[j]] > bucket_sizes[order[biggest]]) biggest = j;
+    j = order[i];
+    order[i] = order[biggest];
+    order[biggest] = j;
+  }
+
+  for(i = 0; i < length && bucket_sizes[order[i]]; i++) {
+    bucket = order[i];
+
+    for(seed = 1; seed < MAX_DISPLACEMENT; seed++) {
+      fits = true;
+      placed_length = 0;
+
+      for(j = 0; j < length && fits; j++) {
+        if(hash(spec->args[keys[j]].big, 0) % length != bucket) continue;
+
+        slot = hash(spec->args[keys[j]].big, seed) % length;
+        fits = slots[slot] == -1;
+        for(k = 0; k < placed_length && fits; k++)
+          fits = placed[k] != slot;
+        placed[placed_length++] = slot;
+      }
+      if(fits) break;
+    }
+    if(seed == MAX_DISPLACEMENT) goto error;
+
+    displacements[bucket] = seed;
+    for(j = 0; j < length; j++) {
+      if(hash(spec->args[keys[j]].big, 0) % length != bucket) continue;
+      slots[hash(spec->args[keys[j]].big, seed) % length] = keys[j];
+    }
+  }
+
+  free(bucket_sizes);
+  free(order);
+  free(placed);
+  return true;
+
+  error:
+    free(bucket_sizes);
+    free(order);
+    free(placed);
+    return false;
+}
+
+/*! Writes a string as a C string literal
+ *
+ *  @param [file] The file to write to
+ *  @param [str] The string to write, or NULL to write NULL
+ */
+static void write_string(FILE* file, const char* str) {
+  if(! str) {
+    fputs("NULL", file);
+    return;
+  }
+
+  fputc('"', file);
+  for(; *str; str++) {
+    if(*str == '"' || *str == '\\') fputc('\\', file);
+    fputc(*str, file);
+  }
+  fputc('"', file);
+}
+
+/*! Writes a character as a C character literal
+ *
+ *  @param [file] The file to write to
+ *  @param [c] The character to write
+ */
+static void write_char(FILE* file, char c) {
+  if(c == '\0') fputs("'\\0'", file);
+  else if(c == '\'' || c == '\\') fprintf(file, "'\\%c'", c);
+  else fprintf(file, "'%c'", c);
+}
+
+/*! Gets what should come before an element of a generated array
+ *
+ *  @param [i] The index of the element
+ *  @return The separator, which starts a new line every 8 elements
+ */
+static const char* separator(int i) {
+  if(i == 0) return "\n  ";
+  return i % 8 ? ", " : ",\n  ";
+}
+
+/*! Writes the name of the handle constant for an option
+ *
+ *  @param [file] The file to write to
+ *  @param [name] The name of the spec
+ *  @param [arg] The option to name
+ */
+static void write_handle(FILE* file, const char* name,
+  const struct gen_arg* arg)
+{
+  const char* c;
+
+  for(c = name; *c; c++) fputc(toupper((unsigned char)*c), file);
+  fprintf(file, "_%s", arg->handle);
+}
+
+/*! Writes the header for a generated spec
+ *
+ *  @param [file] The file to write to
+ *  @param [spec] The spec to write
+ *  @param [name] The name of the spec
+ *  @param [source] The definition file the spec came from
+ */
+static void write_header(FILE* file, const struct gen_spec* spec,
+  const char* name, const char* source)
+{
+  int i;
+
+  fprintf(file, "/* Generated by optbotgen from %s.  Do not edit. */\n",
+    source);
+  fprintf(file, "#ifndef __OPTBOT_SPEC_%s_INC__\n", name);
+  fprintf(file, "#define __OPTBOT_SPEC_%s_INC__\n\n", name);
+  fprintf(file, "#include \"liboptbot.h\"\n\n");
+
+  fprintf(file, "/* Handles for use with the optbot_ accessors */\n");
+  fprintf(file, "enum %s_handle {\n", name);
+  for(i = 0; i < spec->args_length; i++) {
+    fputs("  ", file);
+    write_handle(file, name, &spec->args[i]);
+    fputs(",\n", file);
+  }
+  fprintf(file, "};\n\n");
+
+  fprintf(file, "extern const struct optbot_spec %s_spec;\n\n", name);
+  fprintf(file, "#endif\n");
+}
+
+/*! Writes the source for a generated spec
+ *
+ *  @param [file] The file to write to
+ *  @param [spec] The spec to write
+ *  @param [name] The name of the spec
+ *  @param [source] The definition file the spec came from
+ *  @param [header] The name to include the generated header by
+ *  @param [length] The number of options with long options
+ *  @param [displacements] The seed of each bucket of the hash
+ *  @param [slots] The option index held by each slot of the hash
+ */
+static void write_source(FILE* file, const struct gen_spec* spec,
+  const char* name, const char* source, const char* header, int length,
+  const unsigned int* displacements, const int* slots)
+{
+  const struct gen_arg* arg;
+  int i;
+
+  fprintf(file, "/* Generated by optbotgen from %s.  Do not edit. */\n",
+    source);
+  fprintf(file, "#include <string.h>\n\n#include \"%s\"\n\n", header);
+
+  fprintf(file, "static const struct optbot_spec_arg args[] = {\n");
+  for(i = 0; i < spec->args_length; i++) {
+    arg = &spec->args[i];
+    fputs("  {", file);
+    write_char(file, arg->little);
+    fputs(", ", file);
+    write_string(file, arg->big);
+    fputs(", ", file);
+    write_string(file, arg->description);
+    fprintf(file, ", %s, %d},\n",
+      arg->takes_value ? "true" : "false", arg->max_times);
+  }
+  fprintf(file, "};\n\n");
+
+  fprintf(file, "static int find_little(char little) {\n");
+  fprintf(file, "  switch(little) {\n");
+  for(i = 0; i < spec->args_length; i++) {
+    if(! spec->args[i].little) continue;
+    fputs("    case ", file);
+    write_char(file, spec->args[i].little);
+    fprintf(file, ": return %d;\n", i);
+  }
+  fprintf(file, "    default: return -1;\n");
+  fprintf(file, "  }\n}\n\n");
+
+  if(! length) {
+    fprintf(file, "static int find_big(const char* big) {\n");
+    fprintf(file, "  return -1;\n}\n\n");
+  } else {
+    fprintf(file,
+      "static unsigned int hash(const char* key, unsigned int seed) {\n"
+      "  unsigned int hash = 2166136261u ^ (seed * 16777619u);\n"
+      "\n"
+      "  while(*key) {\n"
+      "    hash ^= (unsigned char)*key++;\n"
+      "    hash *= 16777619u;\n"
+      "  }\n"
+      "  hash ^= hash >> 15;\n"
+      "  hash *= 0x2c1b3c6du;\n"
+      "  hash ^= hash >> 12;\n"
+      "\n"
+      "  return hash;\n"
+      "}\n\n");
+
+    fprintf(file, "static const unsigned int displacements[] = {");
+    for(i = 0; i < length; i++)
+      fprintf(file, "%s%u", separator(i), displacements[i]);
+    fprintf(file, "\n};\n\n");
+
+    fprintf(file, "static const int slots[] = {");
+    for(i = 0; i < length; i++)
+      fprintf(file, "%s%d", separator(i), slots[i]);
+    fprintf(file, "\n};\n\n");
+
+    fprintf(file,
+      "static int find_big(const char* big) {\n"
+      "  int i = slots[hash(big, displacements[hash(big, 0) %% %d]) %% %d];\n"
+      "  return strcmp(args[i].big, big) == 0 ? i : -1;\n"
+      "}\n\n", length, length);
+  }
+
+  fprintf(file, "const struct optbot_spec %s_spec = {\n", name);
+  fprintf(file, "  \"%s\", %d, args, find_little, find_big\n};\n",
+    name, spec->args_length);
+}
+
+/*! Determines whether a string is a valid C identifier
+ *
+ *  @param [str] The string to check
+ *  @return Is str a valid identifier?
+ */
+static bool is_identifier(const char* str) {
+  if(! isalpha((unsigned char)*str) && *str != '_') return false;
+  for(; *str; str++)
+    if(! isalnum((unsigned char)*str) && *str != '_') return false;
+  return true;
+}
+
+int main(int argc, char** argv) {
+  struct gen_spec spec = {NULL, 0, 0};
+  unsigned int* displacements = NULL;
+  int* slots = NULL;
+  int* keys = NULL;
+  int length = 0;
+  char* path = NULL;
+  const char* header;
+  FILE* file = NULL;
+  int i;
+
+  if(argc != 4 || ! is_identifier(argv[2])) {
+    fprintf(stderr, "Usage: %s <definition file> <spec name> "
+      "<output prefix>\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  if(! read_spec(argv[1], &spec)) return EXIT_FAILURE;
+
+  keys = malloc(sizeof(int) * (spec.args_length + 1));
+  displacements = malloc(sizeof(unsigned int) * (spec.args_length + 1));
+  slots = malloc(sizeof(int) * (spec.args_length + 1));
+  path = malloc(strlen(argv[3]) + 3);
+  if(! keys || ! displacements || ! slots || ! path) goto error;
+
+  for(i = 0; i < spec.args_length; i++)
+    if(spec.args[i].big) keys[length++] = i;
+
+  if(length && ! build_hash(&spec, keys, length, displacements, slots)) {
+    fprintf(stderr, "optbotgen: couldn't find a perfect hash\n");
+    goto error;
+  }
+
+  sprintf(path, "%s.h", argv[3]);
+  file = fopen(path, "w");
+  if(! file) goto error;
+  write_header(file, &spec, argv[2], argv[1]);
+  if(fclose(file) != 0) goto error;
+
+  header = strrchr(path, '/') ? strrchr(path, '/') + 1 : path;
+  path[strlen(path) - 1] = 'c';
+  file = fopen(path, "w");
+  if(! file) goto error;
+  path[strlen(path) - 1] = 'h';
+  write_source(file, &spec, argv[2], argv[1], header, length,
+    displacements, slots);
+  if(fclose(file) != 0) goto error;
+
+  return EXIT_SUCCESS;
+
+  error:
+    if(path) fprintf(stderr, "optbotgen: couldn't write %s\n", path);
+    return EXIT_FAILURE;
+}